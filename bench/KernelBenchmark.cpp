@@ -0,0 +1,423 @@
+// Microbenchmark of the intersection kernels in Kernels.h on random primitives and rays, in two parts: the
+// specialized templates against the runtime-flag tests they replaced, and the Moller-Trumbore triangle test
+// against the four-determinant solve it replaced. Build target: KernelBenchmark.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <glm/glm.hpp>
+#include <rendering/Kernels.h>
+
+static const int TRIANGLE_COUNT = 4096;
+static const int SPHERE_COUNT = 4096;
+static const int RAY_COUNT = 512;
+static const int REPEATS = 5;
+
+struct BenchRay
+{
+	glm::vec3 origin;
+	glm::vec3 direction;
+	bool transmitted;
+};
+
+// the triangle test as it was before the kernels: one function for every call site, face culling decided per call
+// and the barycentrics always computed
+static bool triangle_intersect_runtime(const Triangle& triangle, const glm::vec3& origin, const glm::vec3& direction, float& t, glm::vec3& hit_bary,
+									   bool ignore_backface, bool& backface)
+{
+	backface = glm::dot(direction, triangle.normal) > -KERNEL_EPSILON;
+	if (backface && ignore_backface) return false;
+
+	glm::vec3 pvec = glm::cross(direction, triangle.edge2);
+	float inv_det = 1.0f / glm::dot(triangle.edge1, pvec);
+
+	glm::vec3 tvec = origin - triangle.vertex;
+	hit_bary.y = glm::dot(tvec, pvec) * inv_det;
+	if (hit_bary.y < 0.0f || hit_bary.y > 1.0f) return false;
+
+	glm::vec3 qvec = glm::cross(tvec, triangle.edge1);
+	hit_bary.z = glm::dot(direction, qvec) * inv_det;
+	if (hit_bary.z < 0.0f || hit_bary.y + hit_bary.z > 1.0f) return false;
+	hit_bary.x = 1.0f - hit_bary.y - hit_bary.z;
+
+	t = glm::dot(triangle.edge2, qvec) * inv_det;
+	return true;
+}
+
+// the sphere test before the kernels: both roots are returned and the caller picks one and checks the face
+static bool sphere_intersect_runtime(const Sphere& sphere, const glm::vec3& origin, const glm::vec3& direction, float& t, float& t2, bool& backface)
+{
+	float t0, t1;
+	glm::vec3 L = origin - glm::vec3(sphere.definition);
+
+	float c = (-sphere.definition.w * sphere.definition.w) + glm::dot(L, L);
+	backface = c < 0.0f;
+
+	float cosangle = glm::dot(direction, -L);
+
+	if (!backface)
+	{
+		float limit = (sphere.definition.w / -3.0f) + glm::length(L);
+		if (cosangle < limit) return false;
+	}
+
+	float a = glm::dot(direction, direction);
+	float b = -2.0f * cosangle;
+	float discr = b * b - 4.0f * a * c;
+	if (discr < 0.0f)
+		return false;
+	else if (discr == 0.0f)
+	{
+		t0 = -0.5f * b / a;
+		t1 = t0;
+	}
+	else
+	{
+		float q = (b > 0) ? -0.5f * (b + std::sqrt(discr)) : -0.5f * (b - std::sqrt(discr));
+		t0 = q / a;
+		t1 = c / q;
+	}
+
+	if (t0 > t1) std::swap(t0, t1);
+
+	if (t0 < 0)
+	{
+		t0 = t1;
+		if (t0 < 0) return false;
+	}
+
+	t = t0;
+	t2 = t1;
+	return true;
+}
+
+// The triangle test before Moller-Trumbore: Cramer's rule on the vertices read through the indices. Its
+// bounding-sphere pre-test is left out, it was not conservative and would make the hits differ.
+template<FaceMode Faces, bool NeedAttributes>
+static bool triangle_intersect_determinants(const Triangle& triangle, const Vertex* vertices, const glm::vec3& origin, const glm::vec3& direction,
+											float& t, glm::vec3& hit_bary, bool& backface)
+{
+	bool is_backface = glm::dot(direction, triangle.normal) > -KERNEL_EPSILON;
+	if (!face_accepted<Faces>(is_backface)) return false;
+	if (NeedAttributes) backface = is_backface;
+
+	const glm::vec3& vert1 = vertices[triangle.indices.x].position;
+	const glm::vec3& vert2 = vertices[triangle.indices.y].position;
+	const glm::vec3& vert3 = vertices[triangle.indices.z].position;
+
+	glm::vec3 col1 = -direction;
+	glm::vec3 col2 = vert2 - vert1;
+	glm::vec3 col3 = vert3 - vert1;
+	glm::vec3 rhs = origin - vert1;
+
+	float mdet = glm::determinant(glm::mat3(col1, col2, col3));
+
+	float bary_y = glm::determinant(glm::mat3(col1, rhs, col3)) / mdet;
+	if (bary_y < 0.0f) return false;
+
+	float bary_z = glm::determinant(glm::mat3(col1, col2, rhs)) / mdet;
+	if (bary_z < 0.0f || bary_y + bary_z > 1.0f) return false;
+	if (NeedAttributes) hit_bary = glm::vec3(1.0f - bary_y - bary_z, bary_y, bary_z);
+
+	t = glm::determinant(glm::mat3(rhs, col2, col3)) / mdet;
+	return true;
+}
+
+// hits found by one run and a checksum of their distances, to check that both sides of a comparison agree
+struct Result
+{
+	int hits;
+	double t_sum;
+};
+
+static void add_hit(Result& result, float t)
+{
+	result.hits++;
+	result.t_sum += t;
+}
+
+static void make_triangles(std::mt19937& rng, std::vector<Vertex>& vertices, std::vector<Triangle>& triangles)
+{
+	std::uniform_real_distribution<float> pos(-10.0f, 10.0f);
+	std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+
+	for (int i = 0; i < TRIANGLE_COUNT; i++)
+	{
+		glm::vec3 center(pos(rng), pos(rng), pos(rng));
+		glm::vec3 p[3];
+		for (int v = 0; v < 3; v++)
+		{
+			p[v] = center + glm::vec3(offset(rng), offset(rng), offset(rng));
+			vertices.push_back(Vertex(p[v], glm::vec3(0.0f), Material()));
+		}
+
+		glm::vec3 normal = glm::normalize(glm::cross(p[1] - p[0], p[2] - p[0]));
+		unsigned first = (unsigned)i * 3;
+		triangles.push_back(Triangle(glm::uvec3(first, first + 1, first + 2), normal, glm::mat2(0.0f), p[0], p[1], p[2]));
+	}
+}
+
+static void make_spheres(std::mt19937& rng, std::vector<Sphere>& spheres)
+{
+	std::uniform_real_distribution<float> pos(-10.0f, 10.0f);
+	std::uniform_real_distribution<float> radius(0.1f, 0.7f);
+
+	for (int i = 0; i < SPHERE_COUNT; i++)
+	{
+		Sphere sphere;
+		sphere.definition = glm::vec4(pos(rng), pos(rng), pos(rng), radius(rng));
+		spheres.push_back(sphere);
+	}
+}
+
+static void make_rays(std::mt19937& rng, bool transmitted, bool shadow, std::vector<BenchRay>& rays)
+{
+	std::uniform_real_distribution<float> pos(-10.0f, 10.0f);
+
+	rays.clear();
+	for (int i = 0; i < RAY_COUNT; i++)
+	{
+		BenchRay ray;
+		ray.origin = glm::vec3(pos(rng), pos(rng), pos(rng));
+		glm::vec3 target(pos(rng), pos(rng), pos(rng));
+		// shadow rays span the segment to the light (t in 0..1), the others are normalized
+		ray.direction = shadow ? target - ray.origin : glm::normalize(target - ray.origin);
+		ray.transmitted = transmitted;
+		rays.push_back(ray);
+	}
+}
+
+// best time of the runs in primitive tests per second
+template<typename F>
+static double tests_per_second(int primitives, F test, Result& result)
+{
+	double best = 1e30;
+	for (int r = 0; r < REPEATS; r++)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		result = test();
+		auto end = std::chrono::high_resolution_clock::now();
+		best = glm::min(best, std::chrono::duration<double>(end - start).count());
+	}
+	return (double)primitives * RAY_COUNT / best;
+}
+
+// Closest hit over all triangles, as the BVH leaves do it for primary, reflected and transmitted rays. Test
+// intersects one triangle and returns whether it is hit and where.
+template<typename Test>
+static Result closest_triangle(const std::vector<Triangle>& triangles, const std::vector<BenchRay>& rays, const Test& test)
+{
+	Result result = { 0, 0.0 };
+	for (const BenchRay& ray : rays)
+	{
+		float t = 1e30f, t_obj;
+		for (const Triangle& triangle : triangles)
+		{
+			if (test(triangle, ray, t_obj) && t_obj < t && t_obj > 0.0f) t = t_obj;
+		}
+		if (t < 1e30f) add_hit(result, t);
+	}
+	return result;
+}
+
+// occlusion by any opaque triangle between the origin and the light, as the shadow rays do it
+template<typename Test>
+static Result occluding_triangles(const std::vector<Triangle>& triangles, const std::vector<BenchRay>& rays, const Test& test)
+{
+	Result result = { 0, 0.0 };
+	for (const BenchRay& ray : rays)
+	{
+		float t_obj;
+		for (const Triangle& triangle : triangles)
+		{
+			if (test(triangle, ray, t_obj) && t_obj < 1.0f && t_obj > 0.0f) add_hit(result, t_obj);
+		}
+	}
+	return result;
+}
+
+static Result closest_sphere_runtime(const std::vector<Sphere>& spheres, const std::vector<BenchRay>& rays)
+{
+	Result result = { 0, 0.0 };
+	for (const BenchRay& ray : rays)
+	{
+		float t = 1e30f, t_obj, t_discard;
+		bool backface;
+		for (const Sphere& sphere : spheres)
+		{
+			if (sphere_intersect_runtime(sphere, ray.origin, ray.direction, t_obj, t_discard, backface) && t_obj < t && t_obj > 0.0f && (ray.transmitted || !backface))
+				t = t_obj;
+		}
+		if (t < 1e30f) add_hit(result, t);
+	}
+	return result;
+}
+
+template<FaceMode Faces>
+static Result closest_sphere_specialized(const std::vector<Sphere>& spheres, const std::vector<BenchRay>& rays)
+{
+	Result result = { 0, 0.0 };
+	for (const BenchRay& ray : rays)
+	{
+		float t = 1e30f, t_obj;
+		bool backface;
+		for (const Sphere& sphere : spheres)
+		{
+			if (sphere_intersect<HitMode::Closest, Faces>(sphere, ray.origin, ray.direction, t_obj, backface) && t_obj < t && t_obj > 0.0f) t = t_obj;
+		}
+		if (t < 1e30f) add_hit(result, t);
+	}
+	return result;
+}
+
+static Result occluding_spheres_runtime(const std::vector<Sphere>& spheres, const std::vector<BenchRay>& rays)
+{
+	Result result = { 0, 0.0 };
+	for (const BenchRay& ray : rays)
+	{
+		float t_discard, t_obj;
+		bool backface;
+		for (const Sphere& sphere : spheres)
+		{
+			if (sphere_intersect_runtime(sphere, ray.origin, ray.direction, t_discard, t_obj, backface) && t_obj < 1.0f && t_obj > 0.0f) add_hit(result, t_obj);
+		}
+	}
+	return result;
+}
+
+static Result occluding_spheres_specialized(const std::vector<Sphere>& spheres, const std::vector<BenchRay>& rays)
+{
+	Result result = { 0, 0.0 };
+	for (const BenchRay& ray : rays)
+	{
+		float t_obj;
+		bool backface;
+		for (const Sphere& sphere : spheres)
+		{
+			if (sphere_intersect<HitMode::Any, FaceMode::Both>(sphere, ray.origin, ray.direction, t_obj, backface) && t_obj < 1.0f && t_obj > 0.0f) add_hit(result, t_obj);
+		}
+	}
+	return result;
+}
+
+static void report(const char* name, const char* before_name, double before_rate, const char* after_name, double after_rate, const Result& before, const Result& after)
+{
+	// different arithmetic rounds differently, a hit exactly on an edge may go either way
+	bool agree = before.hits == after.hits && std::abs(before.t_sum - after.t_sum) <= 1e-4 * std::abs(before.t_sum);
+	printf("%-18s %s %6.1f M tests/s, %s %6.1f M tests/s, speedup %.2fx%s\n", name, before_name, before_rate * 1e-6, after_name, after_rate * 1e-6,
+		   after_rate / before_rate, agree ? "" : " (RESULTS DIFFER)");
+}
+
+int main()
+{
+	std::mt19937 rng(1);
+	std::vector<Vertex> vertices;
+	std::vector<Triangle> triangles;
+	std::vector<Sphere> spheres;
+	std::vector<BenchRay> rays;
+	make_triangles(rng, vertices, triangles);
+	make_spheres(rng, spheres);
+
+	Result before, after;
+	double before_rate, after_rate;
+
+	// as the tracer called it: culling for opaque rays only, shadow rays keep the backfaces
+	auto runtime_closest = [](const Triangle& triangle, const BenchRay& ray, float& t)
+	{
+		glm::vec3 bary;
+		bool backface;
+		return triangle_intersect_runtime(triangle, ray.origin, ray.direction, t, bary, !ray.transmitted, backface);
+	};
+	auto runtime_any = [](const Triangle& triangle, const BenchRay& ray, float& t)
+	{
+		glm::vec3 bary;
+		bool backface;
+		return triangle_intersect_runtime(triangle, ray.origin, ray.direction, t, bary, false, backface) && backface;
+	};
+	auto closest_front = [](const Triangle& triangle, const BenchRay& ray, float& t)
+	{
+		glm::vec3 bary;
+		bool backface;
+		return triangle_intersect<FaceMode::Front, true>(triangle, ray.origin, ray.direction, t, bary, backface);
+	};
+	auto closest_both = [](const Triangle& triangle, const BenchRay& ray, float& t)
+	{
+		glm::vec3 bary;
+		bool backface;
+		return triangle_intersect<FaceMode::Both, true>(triangle, ray.origin, ray.direction, t, bary, backface);
+	};
+	auto any_back = [](const Triangle& triangle, const BenchRay& ray, float& t)
+	{
+		glm::vec3 bary;
+		bool backface;
+		return triangle_intersect<FaceMode::Back, false>(triangle, ray.origin, ray.direction, t, bary, backface);
+	};
+
+	printf("Specialized kernels against runtime flags, %d triangles or spheres x %d rays, best of %d runs\n", TRIANGLE_COUNT, RAY_COUNT, REPEATS);
+
+	make_rays(rng, false, false, rays);
+	before_rate = tests_per_second(TRIANGLE_COUNT, [&]() { return closest_triangle(triangles, rays, runtime_closest); }, before);
+	after_rate = tests_per_second(TRIANGLE_COUNT, [&]() { return closest_triangle(triangles, rays, closest_front); }, after);
+	report("triangles, front", "runtime flags", before_rate, "specialized", after_rate, before, after);
+
+	before_rate = tests_per_second(SPHERE_COUNT, [&]() { return closest_sphere_runtime(spheres, rays); }, before);
+	after_rate = tests_per_second(SPHERE_COUNT, [&]() { return closest_sphere_specialized<FaceMode::Front>(spheres, rays); }, after);
+	report("spheres, front", "runtime flags", before_rate, "specialized", after_rate, before, after);
+
+	make_rays(rng, true, false, rays);
+	before_rate = tests_per_second(TRIANGLE_COUNT, [&]() { return closest_triangle(triangles, rays, runtime_closest); }, before);
+	after_rate = tests_per_second(TRIANGLE_COUNT, [&]() { return closest_triangle(triangles, rays, closest_both); }, after);
+	report("triangles, both", "runtime flags", before_rate, "specialized", after_rate, before, after);
+
+	before_rate = tests_per_second(SPHERE_COUNT, [&]() { return closest_sphere_runtime(spheres, rays); }, before);
+	after_rate = tests_per_second(SPHERE_COUNT, [&]() { return closest_sphere_specialized<FaceMode::Both>(spheres, rays); }, after);
+	report("spheres, both", "runtime flags", before_rate, "specialized", after_rate, before, after);
+
+	make_rays(rng, false, true, rays);
+	before_rate = tests_per_second(TRIANGLE_COUNT, [&]() { return occluding_triangles(triangles, rays, runtime_any); }, before);
+	after_rate = tests_per_second(TRIANGLE_COUNT, [&]() { return occluding_triangles(triangles, rays, any_back); }, after);
+	report("triangles, any", "runtime flags", before_rate, "specialized", after_rate, before, after);
+
+	before_rate = tests_per_second(SPHERE_COUNT, [&]() { return occluding_spheres_runtime(spheres, rays); }, before);
+	after_rate = tests_per_second(SPHERE_COUNT, [&]() { return occluding_spheres_specialized(spheres, rays); }, after);
+	report("spheres, any", "runtime flags", before_rate, "specialized", after_rate, before, after);
+
+	printf("Moller-Trumbore against four determinants, %d triangles x %d rays, best of %d runs\n", TRIANGLE_COUNT, RAY_COUNT, REPEATS);
+
+	auto determinants_front = [&](const Triangle& triangle, const BenchRay& ray, float& t)
+	{
+		glm::vec3 bary;
+		bool backface;
+		return triangle_intersect_determinants<FaceMode::Front, true>(triangle, vertices.data(), ray.origin, ray.direction, t, bary, backface);
+	};
+	auto determinants_both = [&](const Triangle& triangle, const BenchRay& ray, float& t)
+	{
+		glm::vec3 bary;
+		bool backface;
+		return triangle_intersect_determinants<FaceMode::Both, true>(triangle, vertices.data(), ray.origin, ray.direction, t, bary, backface);
+	};
+	auto determinants_any = [&](const Triangle& triangle, const BenchRay& ray, float& t)
+	{
+		glm::vec3 bary;
+		bool backface;
+		return triangle_intersect_determinants<FaceMode::Back, false>(triangle, vertices.data(), ray.origin, ray.direction, t, bary, backface);
+	};
+
+	make_rays(rng, false, false, rays);
+	before_rate = tests_per_second(TRIANGLE_COUNT, [&]() { return closest_triangle(triangles, rays, determinants_front); }, before);
+	after_rate = tests_per_second(TRIANGLE_COUNT, [&]() { return closest_triangle(triangles, rays, closest_front); }, after);
+	report("closest, front", "four determinants", before_rate, "Moller-Trumbore", after_rate, before, after);
+
+	before_rate = tests_per_second(TRIANGLE_COUNT, [&]() { return closest_triangle(triangles, rays, determinants_both); }, before);
+	after_rate = tests_per_second(TRIANGLE_COUNT, [&]() { return closest_triangle(triangles, rays, closest_both); }, after);
+	report("closest, both", "four determinants", before_rate, "Moller-Trumbore", after_rate, before, after);
+
+	make_rays(rng, false, true, rays);
+	before_rate = tests_per_second(TRIANGLE_COUNT, [&]() { return occluding_triangles(triangles, rays, determinants_any); }, before);
+	after_rate = tests_per_second(TRIANGLE_COUNT, [&]() { return occluding_triangles(triangles, rays, any_back); }, after);
+	report("any, back", "four determinants", before_rate, "Moller-Trumbore", after_rate, before, after);
+
+	return 0;
+}
@@ -0,0 +1,14 @@
+#version 430
+
+layout(location = 0) out vec4 fragColor;
+
+// float render target of the framebuffer's size, or smaller when output_size is set
+uniform sampler2D source;
+// framebuffer size when the source is smaller and scaled up bilinearly, 0 to copy it texel by texel
+uniform vec2 output_size;
+
+void main()
+{
+	if (output_size.x > 0.0f) fragColor = vec4(textureLod(source, gl_FragCoord.xy / output_size, 0.0f).rgb, 1.0f);
+	else fragColor = vec4(texelFetch(source, ivec2(gl_FragCoord.xy), 0).rgb, 1.0f);
+}
@@ -0,0 +1,17 @@
+// Per-frame camera state of Raytrace.frag and WavefrontGenerate.comp, uploaded once per frame by
+// FrameUniforms into uniform buffer binding 0. std140: every vec3 takes 16 bytes.
+layout(std140, binding = 0) uniform Frame
+{
+	vec3 cam_pos;
+	vec3 img_origin;
+	vec3 img_right;
+	vec3 img_up;
+	vec2 pixel_size;
+	vec2 jitter; // subpixel offset of progressive frames, in pixels
+	uint frame_index;
+	// the camera of the last frame, for reprojection
+	vec3 prev_cam_pos;
+	vec3 prev_img_origin;
+	vec3 prev_img_right;
+	vec3 prev_img_up;
+};
@@ -1,331 +1,219 @@
 #version 430
 
-const float INFINITY = uintBitsToFloat(0x7F800000);
-const float EPSILON = 1e-4f;
-const float PI = 3.14159265359f;
-const float TWOPI = 2.0f * PI;
-
-const uint RECURSION_DEPTH = 5;
-const uint MAX_RAYS = 31;
-
-struct Ray
-{
-	vec3 origin;
-	vec3 direction;
-	vec3 color_mult;
-	int depth;
-	bool transmitted;
-};
-
-struct Material
-{
-	vec3 ambient;
-	vec4 diffuse;
-	vec4 specular;
-	vec3 emissive;
-	vec3 reflective;
-	ivec4 textures;
-	int normalmap;
-	float eta;
-};
-
-struct Vertex
-{
-	vec3 position;
-	vec3 normal;
-	vec2 uv;
-	Material material;
-};
-
-struct Triangle
-{
-	uvec3 indices;
-	vec3 normal;
-	mat2 uvtrans;
-	vec4 enc_sphere;
-};
-
-struct Light
-{
-	int type;
-	vec3 position;
-	vec3 direction;
-	vec3 color;
-	float intensity;
-};
-
-struct Sphere
-{
-	vec4 definition;
-	Material material;
-};
+#include "RaytraceCommon.glsl"
+#include "Frame.glsl"
 
 layout(location = 0) out vec4 fragColor;
+// primary hit of the edge base pass: geometric normal and distance, and the object class
+layout(location = 1) out vec4 fragGeometry;
+layout(location = 2) out uint fragObject;
 
 in vec3 pixel_position;
 
-uniform vec3 cam_pos;
-uniform vec3 img_origin;
-uniform vec3 img_right;
-uniform vec3 img_up;
-
-uniform vec4 ground_plane;
-
-uniform sampler2D textures[20];
-uniform vec2 pixel_size;
-
-
-layout(std430, binding = 0) buffer LightBuffer
+// Sample placement, mirrors RaytraceSampling in AdaptiveSampler.h.
+// MULTISAMPLE: every sample of the multisampled framebuffer is traced.
+// JITTER: progressive frames are traced once per pixel, offset by jitter (in pixels).
+// EDGE_BASE: one sample at the pixel center, writing the primary hit for edge detection.
+// EDGE_REFINE: edge_samples more samples on the pixels next to a depth, normal or object edge, discarding the others.
+// SECONDARY: one sample at the center of every pixel of the reduced secondary target, writing its secondary radiance
+// and primary hit.
+#define SAMPLING_MULTISAMPLE 0
+#define SAMPLING_JITTER 1
+#define SAMPLING_EDGE_BASE 2
+#define SAMPLING_EDGE_REFINE 3
+#define SAMPLING_SECONDARY 4
+
+// STOCHASTIC_PATHS follows one path per sample instead of the whole ray tree, meant for accumulation
+#ifndef STOCHASTIC_PATHS
+#define STOCHASTIC_PATHS 0
+#endif
+// VISIBILITY_BUFFER takes the primary hits of the single-sample modes from the rasterized visibility buffer
+#ifndef VISIBILITY_BUFFER
+#define VISIBILITY_BUFFER 0
+#endif
+// TEMPORAL_CACHE reuses the secondary radiance of the last frames in the single-sample modes
+#ifndef TEMPORAL_CACHE
+#define TEMPORAL_CACHE 0
+#endif
+// LOW_RES_SECONDARY takes the secondary radiance from the reduced target of the secondary pass
+#ifndef LOW_RES_SECONDARY
+#define LOW_RES_SECONDARY 0
+#endif
+
+uniform int sampling;
+uniform int edge_samples;
+uniform sampler2D edge_geometry;
+uniform usampler2D edge_object;
+layout(binding = 0, offset = 0) uniform atomic_uint edge_pixel_count;
+
+#if VISIBILITY_BUFFER
+// closest sphere or triangle per pixel, see VisibilityBuffer
+uniform usampler2D visibility;
+// set for the samples the visibility buffer was rasterized at
+bool primary_visible = false;
+#endif
+
+const float EDGE_NORMAL_COS = 0.9f;
+const float EDGE_DEPTH_RATIO = 0.05f;
+
+#if TEMPORAL_CACHE || LOW_RES_SECONDARY
+// color of the primary hit alone, recorded where the secondary rays may be replaced
+vec3 primary_color = vec3(0.0f);
+#endif
+
+#if TEMPORAL_CACHE
+// The last frame's history, see TemporalCache: per pixel the primary hit position and object class, the geometric
+// normal and the frames since the secondary rays were traced, and the radiance of all rays after the primary one.
+// This frame's history goes to the images.
+uniform sampler2D history_position;
+uniform sampler2D history_normal;
+uniform sampler2D history_radiance;
+layout(binding = 0, rgba32f) uniform writeonly image2D next_position;
+layout(binding = 1, rgba16f) uniform writeonly image2D next_normal;
+layout(binding = 2, rgba16f) uniform writeonly image2D next_radiance;
+// frames a traced secondary result is used for
+uniform uint history_length;
+
+const float HISTORY_NORMAL_COS = 0.9f;
+const float HISTORY_DISTANCE_RATIO = 0.02f;
+// order in which the pixels of a 4x4 block trace their secondary rays, spread out like a Bayer matrix
+const uint REFRESH_ORDER[16] = uint[16](0u, 8u, 2u, 10u, 12u, 4u, 14u, 6u, 3u, 11u, 1u, 9u, 15u, 7u, 13u, 5u);
+
+// set for the samples the history is kept for; the primary hit of the sample and its cached radiance,
+// history_age is 0 when the secondary rays were traced
+bool temporal_sample = false;
+vec3 primary_position = vec3(0.0f);
+vec3 cached_radiance = vec3(0.0f);
+float history_age = 0.0f;
+
+// image position in [0, 1) of a world position as seen by the last frame's camera
+vec2 previous_image_position(const in vec3 position)
 {
-	Light lights[];
-};
+	vec3 to_origin = prev_img_origin - prev_cam_pos;
+	vec3 to_center = to_origin + 0.5f * (prev_img_right + prev_img_up);
+	vec3 offset = position - prev_cam_pos;
 
-layout(std430, binding = 1) buffer SphereBuffer
-{
-	Sphere spheres[];
-};
-
-layout(std430, binding = 2) buffer VertexBuffer
-{
-	Vertex vertices[];
-};
+	float w = dot(offset, to_center) / dot(to_center, to_center);
+	if (!(w > 0.0f)) return vec2(-1.0f);
 
-layout(std430, binding = 3) buffer TriangleBuffer
-{
-	Triangle triangles[];
-};
-
-
-float max_axis(const in vec3 v)
-{
-	vec3 vabs = abs(v);
-	return max(vabs.x, max(vabs.y, vabs.z));
+	vec3 on_plane = offset / w - to_origin;
+	return vec2(dot(on_plane, prev_img_right) / dot(prev_img_right, prev_img_right), dot(on_plane, prev_img_up) / dot(prev_img_up, prev_img_up));
 }
 
-bool plane_intersect(const in vec4 plane, const in Ray ray, out float t, out bool backface)
+// Adds the secondary radiance cached for the primary hit to color, unless the pixel has to trace its secondary rays:
+// it is its turn in the rotating refresh order, the hit was not visible at its pixel in the last frame (disocclusion),
+// or the cached radiance is history_length - 1 frames old already.
+bool reuse_secondary(const in vec3 position, const in vec4 geometry, const in uint object, inout vec3 color)
 {
-	float dn = dot(ray.direction, plane.xyz);
-	backface = dn > -EPSILON;
-	float en = dot(ray.origin, plane.xyz);
-	t = (plane.w - en) / dn;
-	return true;
-}
+	if (!temporal_sample) return false;
 
-bool sphere_intersect(const in Sphere sphere, const in Ray ray, out float t, out float t2, out bool backface)
-{
-	float t0, t1;
-	vec3 L = ray.origin - sphere.definition.xyz;
+	primary_position = position;
+	primary_color = color;
+	history_age = 0.0f;
 
-	float c = (-sphere.definition.w * sphere.definition.w) + dot(L, L);
-	backface = c < 0.0f;
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	if ((REFRESH_ORDER[(pixel.y & 3) * 4 + (pixel.x & 3)] + frame_index) % history_length == 0u) return false;
 
-	float cosangle = dot(ray.direction, -L);
+	vec2 image_pos = previous_image_position(position);
+	if (!all(greaterThanEqual(image_pos, vec2(0.0f))) || !all(lessThan(image_pos, vec2(1.0f)))) return false;
+	ivec2 prev_pixel = ivec2(image_pos / pixel_size);
 
-	if (!backface)
-	{
-		float limit = (sphere.definition.w / -3.0f) + length(L);
-		if (cosangle < limit) return false;
-	}
+	vec4 prev_position = texelFetch(history_position, prev_pixel, 0);
+	vec4 prev_normal = texelFetch(history_normal, prev_pixel, 0);
+	if (uint(prev_position.w) != object || prev_normal.w + 1.0f >= float(history_length)) return false;
+	if (dot(prev_normal.xyz, geometry.xyz) < HISTORY_NORMAL_COS) return false;
+	if (distance(prev_position.xyz, position) > HISTORY_DISTANCE_RATIO * geometry.w) return false;
 
-	float a = dot(ray.direction, ray.direction);
-	float b = -2.0f * cosangle;
-	// solve quadratic function
-	float discr = b*b - 4.0f * a * c;
-	if (discr < 0.0f)
-		return false;
-	else if (discr == 0.0f)
-	{
-		t0 = -0.5f * b / a;
-		t1 = t0;
-	}
-	else
-	{
-		float q = (b > 0) ? -0.5f * (b + sqrt(discr)) : -0.5f * (b - sqrt(discr));
-		t0 = q / a;
-		t1 = c / q;
-	}
-
-	if (t0 > t1)
-	{
-		float temp = t0;
-		t0 = t1;
-		t1 = temp;
-	}
-
-	if (t0 < 0)
-	{
-		t0 = t1; // use t1 if t0 is negative
-		if (t0 < 0) return false; // both negative
-	}
-
-	t = t0;
-	t2 = t1;
+	history_age = prev_normal.w + 1.0f;
+	cached_radiance = texelFetch(history_radiance, prev_pixel, 0).rgb;
+	color += cached_radiance;
 	return true;
 }
 
-bool triangle_intersect(const in Triangle triangle, const in Ray ray, out float t, out vec3 hit_bary, const in bool ignore_backface, out bool backface)
+// writes the sample's history for the next frame; a miss leaves object class 0, which no hit matches
+void store_history(const in vec3 color, const in vec4 geometry, const in uint object)
 {
-	backface = dot(ray.direction, triangle.normal) > -EPSILON;
-	if (backface && ignore_backface) return false;
-
-	vec3 to_center = triangle.enc_sphere.xyz - ray.origin;
-	float enc_dot = dot(ray.direction, to_center);
-	float limit = (triangle.enc_sphere.w / -3.0f) + length(to_center);
-	if (enc_dot < limit) return false;
-
-	vec3 vert1 = vertices[triangle.indices.x].position;
-	vec3 vert2 = vertices[triangle.indices.y].position;
-	vec3 vert3 = vertices[triangle.indices.z].position;
-
-	vec3 col1 = -ray.direction;
-	vec3 col2 = vert2 - vert1;
-	vec3 col3 = vert3 - vert1;
-	vec3 rhs = ray.origin - vert1;
-
-	float mdet = determinant(mat3(col1, col2, col3));
-
-	hit_bary.y = determinant(mat3(col1, rhs, col3)) / mdet;
-	if (hit_bary.y < 0.0f) return false;
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	vec3 radiance = history_age > 0.0f ? cached_radiance : color - primary_color;
 
-	hit_bary.z = determinant(mat3(col1, col2, rhs)) / mdet;
-	if (hit_bary.z < 0.0f || hit_bary.y + hit_bary.z > 1.0f) return false;
-	hit_bary.x = 1.0f - hit_bary.y - hit_bary.z;
-
-	t = determinant(mat3(rhs, col2, col3)) / mdet;
-	return true;
+	imageStore(next_position, pixel, vec4(primary_position, float(object)));
+	imageStore(next_normal, pixel, vec4(geometry.xyz, history_age));
+	imageStore(next_radiance, pixel, vec4(radiance, 0.0f));
 }
-
-void get_object_properties(const in uint object, const in vec3 position, const in vec3 bary, out Material mat, out vec3 normal)
+#endif
+
+#if LOW_RES_SECONDARY
+// The secondary pass, see SecondaryUpsampler: per pixel of the reduced target the radiance of all rays after the
+// primary one, the primary hit's geometric normal and distance, and its object class.
+uniform sampler2D secondary_radiance;
+uniform sampler2D secondary_geometry;
+uniform usampler2D secondary_object;
+// render pixels per reduced pixel in each dimension
+uniform int secondary_downscale;
+
+const float SECONDARY_NORMAL_POWER = 16.0f;
+// relative distance difference at which a reduced pixel's weight falls to 1/e
+const float SECONDARY_DEPTH_RATIO = 0.05f;
+// how well at least one reduced pixel has to match for its radiance to stand in for the sample's
+const float SECONDARY_MIN_MATCH = 0.5f;
+
+// Adds the secondary radiance of the four reduced pixels around the sample to color, with bilinear weights scaled
+// by how well their primary hits match the sample's in object, distance and normal; false if none matches, so
+// the sample traces its own secondary rays. The secondary pass only records the primary color.
+bool upsample_secondary(const in vec2 sample_pos, const in vec4 geometry, const in uint object, inout vec3 color)
 {
-	vec2 uv = vec2(0.0f);
-
-	if (object == 0) //ground plane
+	primary_color = color;
+	if (sampling == SAMPLING_SECONDARY) return false;
+
+	ivec2 size = textureSize(secondary_object, 0);
+	vec2 low_pos = sample_pos / (float(secondary_downscale) * pixel_size) - 0.5f;
+	ivec2 base = ivec2(floor(low_pos));
+	vec2 f = low_pos - vec2(base);
+
+	vec3 radiance = vec3(0.0f);
+	float total = 0.0f;
+	float best = 0.0f;
+	for (int i = 0; i < 4; i++)
 	{
-		mat.diffuse = vec4(1.0f);
-		mat.ambient = mat.diffuse.xyz;
-		mat.specular = vec4(1.0f, 1.0f, 1.0f, 40.0f);
-		mat.emissive = mat.ambient / 15.0f;
-		mat.reflective = vec3(0.0f);
-		mat.textures = ivec4(0, -1, 0, -1);
-		uv = (position.xz / 10.0f) - .25f;
-		vec3 snormal = ground_plane.xyz;
-		vec3 tanx, tany;
-		if (snormal.x == 0.0f && snormal.z == 0.0f)
-		{
-			tanx = vec3(1.0f, 0.0f, 0.0f);
-			tany = vec3(0.0f, 0.0f, 1.0f);
-		}
-		else
-		{
-			tanx = cross(vec3(0.0f, 1.0f, 0.0f), snormal);
-			tany = cross(snormal, tanx);
-		}
-		vec3 map_normal = 2.0f * texture(textures[1], uv).xyz - 1.0f;
-		normal = normalize(map_normal.x * tanx + map_normal.y * tany + map_normal.z * snormal);
-		//normal = snormal;
+		ivec2 offset = ivec2(i & 1, i >> 1);
+		ivec2 coord = clamp(base + offset, ivec2(0), size - 1);
+		if (texelFetch(secondary_object, coord, 0).r != object) continue;
+
+		vec4 tap = texelFetch(secondary_geometry, coord, 0);
+		float depth = (tap.w - geometry.w) / (SECONDARY_DEPTH_RATIO * geometry.w);
+		float match = exp(-depth * depth) * pow(max(dot(tap.xyz, geometry.xyz), 0.0f), SECONDARY_NORMAL_POWER);
+		// a matching pixel keeps some weight where its bilinear one is 0
+		float weight = ((offset.x == 1 ? f.x : 1.0f - f.x) * (offset.y == 1 ? f.y : 1.0f - f.y) + 1e-3f) * match;
+
+		radiance += weight * texelFetch(secondary_radiance, coord, 0).rgb;
+		total += weight;
+		best = max(best, match);
 	}
-	else if (object <= spheres.length()) //sphere
-	{
-		Sphere sphere = spheres[object - 1];
-		mat = sphere.material;
-		vec3 snormal = normalize(position - sphere.definition.xyz);
-		uv = vec2(asin(snormal.x) / TWOPI, acos(snormal.y) / PI);
-		normal = snormal;
-		if (mat.normalmap < 0) normal = snormal;
-		else
-		{
-			vec3 tanx, tany;
-			if (snormal.x == 0.0f && snormal.z == 0.0f)
-			{
-				tanx = vec3(1.0f, 0.0f, 0.0f);
-				tany = vec3(0.0f, 0.0f, 1.0f);
-			}
-			else
-			{
-				tanx = cross(vec3(0.0f, 1.0f, 0.0f), snormal);
-				tany = cross(snormal, tanx);
-			}
-			vec3 map_normal = 2.0f * texture(textures[mat.normalmap], uv).xyz - 1.0f;
-			normal = normalize(map_normal.x * tanx + map_normal.y * tany + map_normal.z * snormal);
-		}
-	}
-	else
-	{
-		Triangle tri = triangles[object - spheres.length() - 1];
-		Vertex vert1 = vertices[tri.indices.x];
-		Vertex vert2 = vertices[tri.indices.y];
-		Vertex vert3 = vertices[tri.indices.z];
-
-		mat.ambient = bary.x * vert1.material.ambient + bary.y * vert2.material.ambient + bary.z * vert3.material.ambient;
-		mat.diffuse = bary.x * vert1.material.diffuse + bary.y * vert2.material.diffuse + bary.z * vert3.material.diffuse;
-		mat.specular = bary.x * vert1.material.specular + bary.y * vert2.material.specular + bary.z * vert3.material.specular;
-		mat.emissive = bary.x * vert1.material.emissive + bary.y * vert2.material.emissive + bary.z * vert3.material.emissive;
-		mat.reflective = bary.x * vert1.material.reflective + bary.y * vert2.material.reflective + bary.z * vert3.material.reflective;
-		mat.textures = vert1.material.textures;
-		mat.normalmap = vert1.material.normalmap;
-		mat.eta = bary.x * vert1.material.eta + bary.y * vert2.material.eta + bary.z * vert3.material.eta;
-
-		uv = bary.x * vert1.uv + bary.y * vert2.uv + bary.z * vert3.uv;
-
-		vec3 snormal = normalize(bary.x * vert1.normal + bary.y * vert2.normal + bary.z * vert3.normal);
-		if (mat.normalmap < 0 || tri.uvtrans == mat2(0.0f, 0.0f, 0.0f, 0.0f)) normal = snormal;
-		else
-		{
-			vec3 bar1 = vert2.position - vert1.position;
-			vec3 bar2 = vert3.position - vert1.position;
-
-			vec3 map_normal = 2.0f * texture(textures[mat.normalmap], uv).xyz - 1.0f;
 
-			vec2 transformed_xy = tri.uvtrans * map_normal.xy;
-
-			normal = normalize(transformed_xy.x * bar1 + transformed_xy.y * bar2 + map_normal.z * snormal);
-		}
-	}
-
-	if (mat.textures.x >= 0)
-	{
-		vec4 texVal = texture(textures[mat.textures.x], uv);
-		mat.ambient *= texVal.rgb;
-		mat.diffuse *= texVal;
-	}
-	if (mat.textures.y >= 0) mat.specular.xyz *= texture(textures[mat.textures.y], uv).rgb;
-	if (mat.textures.z >= 0) mat.emissive *= texture(textures[mat.textures.z], uv).rgb;
-	if (mat.textures.w >= 0) mat.reflective *= texture(textures[mat.textures.w], uv).rgb;
+	if (best < SECONDARY_MIN_MATCH) return false;
+	color += radiance / total;
+	return true;
 }
+#endif
 
-vec3 phong_lighting(const in vec3 view_dir, const in vec3 normal, const in Material material,
-					const in vec3 light_dir, const in vec3 light_color, const in float light_intensity)
+#if VISIBILITY_BUFFER
+// trace() for the primary ray of the pixel: the visibility buffer holds its closest sphere or triangle, so only
+// that one and the ground plane are intersected, in the order trace_faces tests them. A ray that misses the
+// object only because it rounds differently than the rasterized one gets the full trace.
+bool trace_visible(const in Ray ray, out float t, out vec3 hit_pos, out uint hit_object, out vec3 hit_bary, out bool backface)
 {
-	vec3 result = material.ambient * light_color * light_intensity;
+	uint visible = texelFetch(visibility, ivec2(gl_FragCoord.xy), 0).r;
 
-	float normal_dot_light_dir = dot(normal, -light_dir);
-
-	if (normal_dot_light_dir > 0.0f)
-	{
-		result += material.diffuse.rgb * light_color * (light_intensity * normal_dot_light_dir);
-
-		float reflection_dot_view = dot(reflect(light_dir, normal), view_dir);
-		if (reflection_dot_view > 0)
-		{
-			result += material.specular.rgb * light_color * (light_intensity * pow(reflection_dot_view, material.specular.w));
-		}
-	}
-
-	return result * material.diffuse.a;
-}
-
-bool trace(const in Ray ray, out float t, out vec3 hit_pos, out uint hit_object, out vec3 hit_bary, out bool backface)
-{
 	t = INFINITY;
 	bool hit = false;
 	hit_bary = vec3(0.0f);
 	backface = false;
 
-	float t_obj, t_discard;
-	bool obj_backface;
-	vec3 obj_bary;
+	float t_obj;
+	bool obj_backface, obj_hit;
+	vec3 obj_bary = vec3(0.0f);
 
-	if (plane_intersect(ground_plane, ray, t_obj, obj_backface) && t_obj < t && t_obj > 0.0f && (ray.transmitted || !obj_backface))
+	if (plane_intersect(ground_plane, ray, FACES_FRONT, t_obj, obj_backface) && t_obj < t && t_obj > 0.0f)
 	{
 		t = t_obj;
 		hit_pos = ray.origin + t * ray.direction;
@@ -334,98 +222,43 @@ bool trace(const in Ray ray, out float t, out vec3 hit_pos, out uint hit_object,
 		backface = obj_backface;
 	}
 
-	for (uint i = 0; i < spheres.length(); i++)
-	{
-		Sphere sphere = spheres[i];
-		if (sphere.definition.w < EPSILON) continue;
+	if (visible == 0) return hit;
 
-		if (sphere_intersect(sphere, ray, t_obj, t_discard, obj_backface) && t_obj < t && t_obj > 0.0f && (ray.transmitted || !obj_backface))
-		{
-			t = t_obj;
-			hit_pos = ray.origin + t * ray.direction;
-			hit = true;
-			hit_object = i + 1;
-			backface = obj_backface;
-		}
-	}
+	if (visible <= spheres.length()) obj_hit = sphere_intersect(spheres[visible - 1], ray, HIT_CLOSEST, FACES_FRONT, t_obj, obj_backface);
+	else obj_hit = triangle_intersect(triangles[visible - spheres.length() - 1], ray, FACES_FRONT, t_obj, obj_bary, obj_backface);
+	if (!obj_hit || !(t_obj > 0.0f)) return trace(ray, t, hit_pos, hit_object, hit_bary, backface);
 
-	for (uint i = 0; i < triangles.length(); i++)
+	if (t_obj < t)
 	{
-		Triangle triangle = triangles[i];
-		
-		if (triangle_intersect(triangle, ray, t_obj, obj_bary, !ray.transmitted, obj_backface) && t_obj < t && t_obj > 0.0f)
-		{
-			t = t_obj;
-			hit_pos = ray.origin + t * ray.direction;
-			hit = true;
-			hit_object = i + spheres.length() + 1;
-			hit_bary = obj_bary;
-			backface = obj_backface;
-		}
+		t = t_obj;
+		hit_pos = ray.origin + t * ray.direction;
+		hit = true;
+		hit_object = visible;
+		hit_bary = obj_bary;
+		backface = obj_backface;
 	}
 
 	return hit;
 }
+#endif
 
-bool shadow_trace(const in Ray ray, out vec3 color_mult)
-{
-	vec3 hit_pos, hit_bary, hit_normal = vec3(0.0f);
-	Material hit_mat;
-
-	color_mult = vec3(1.0f);
-
-	float t_obj, t_discard;
-	bool obj_backface;
-
-	if (plane_intersect(ground_plane, ray, t_obj, obj_backface) && t_obj < 1.0f && t_obj > 0.0f && obj_backface)
-	{
-		hit_pos = ray.origin + t_obj * ray.direction;
-		get_object_properties(0, hit_pos, hit_bary, hit_mat, hit_normal);
-		color_mult *= hit_mat.diffuse.rgb * (1.0f - hit_mat.diffuse.a);
-		if (color_mult.r + color_mult.g + color_mult.b < 0.01f) return false;
-	}
-
-	for (uint i = 0; i < spheres.length(); i++)
-	{
-		Sphere sphere = spheres[i];
-		if (sphere.definition.w < EPSILON) continue;
-
-		if (sphere_intersect(sphere, ray, t_discard, t_obj, obj_backface) && t_obj < 1.0f && t_obj > 0.0f)
-		{
-			hit_pos = ray.origin + t_obj * ray.direction;
-			get_object_properties(i + 1, hit_pos, hit_bary, hit_mat, hit_normal);
-			color_mult *= hit_mat.diffuse.rgb * (1.0f - hit_mat.diffuse.a);
-			if (color_mult.r + color_mult.g + color_mult.b < 0.01f) return false;
-		}
-	}
-
-	for (uint i = 0; i < triangles.length(); i++)
-	{
-		Triangle triangle = triangles[i];
-		
-		if (triangle_intersect(triangle, ray, t_obj, hit_bary, false, obj_backface) && t_obj < 1.0f && t_obj > 0.0f && obj_backface)
-		{
-			hit_pos = ray.origin + t_obj * ray.direction;
-			get_object_properties(i + spheres.length() + 1, hit_pos, hit_bary, hit_mat, hit_normal);
-			color_mult *= hit_mat.diffuse.rgb * (1.0f - hit_mat.diffuse.a);
-			if (color_mult.r + color_mult.g + color_mult.b < 0.01f) return false;
-		}
-	}
-
-	return true;
-}
-
-bool cast_ray(Ray ray, out vec3 color, out vec3 hit_pos, out vec3 hit_normal, out Material hit_material, out bool backface)
+bool cast_ray(Ray ray, out vec3 color, out vec3 hit_pos, out uint hit_object, out vec3 hit_normal, out Material hit_material, out bool backface)
 {
 	color = vec3(0.0f);
 
 	float hit_t;
-	uint hit_object;
 	vec3 hit_bary;
 
-	if (trace(ray, hit_t, hit_pos, hit_object, hit_bary, backface) && hit_t >= 0.0f)
+#if VISIBILITY_BUFFER
+	bool hit = primary_visible && ray.depth == 0 ? trace_visible(ray, hit_t, hit_pos, hit_object, hit_bary, backface)
+											   : trace(ray, hit_t, hit_pos, hit_object, hit_bary, backface);
+#else
+	bool hit = trace(ray, hit_t, hit_pos, hit_object, hit_bary, backface);
+#endif
+
+	if (hit && hit_t >= 0.0f)
 	{
-		get_object_properties(hit_object, hit_pos, hit_bary, hit_material, hit_normal);
+		get_object_properties(hit_object, hit_pos, hit_bary, ray.direction, cone_width(ray, hit_t), hit_material, hit_normal);
 
 		if (ray.depth >= RECURSION_DEPTH - 1) hit_material.diffuse.a = 1.0f;
 
@@ -474,11 +307,150 @@ bool cast_ray(Ray ray, out vec3 color, out vec3 hit_pos, out vec3 hit_normal, ou
 	return false;
 }
 
-void main()
-{   	
-	vec3 color;
+// surface normal without normal mapping, so edges follow the geometry and not texture detail
+vec3 geometric_normal(const in uint object, const in vec3 position)
+{
+	if (object == 0) return ground_plane.xyz;
+	if (object <= spheres.length()) return normalize(position - spheres[object - 1].definition.xyz);
+	return triangles[object - spheres.length() - 1].normal;
+}
+
+// 0 for no hit; all triangles share one class so the edges inside a mesh are left to the normal and depth tests
+uint edge_object_class(const in uint object)
+{
+	return object <= spheres.length() ? object + 1 : spheres.length() + 2;
+}
+
+bool is_edge(const in ivec2 pixel)
+{
+	ivec2 size = textureSize(edge_object, 0);
+	uint object = texelFetch(edge_object, pixel, 0).r;
+	vec4 geometry = texelFetch(edge_geometry, pixel, 0);
+
+	for (int axis = 0; axis < 2; axis++)
+	{
+		ivec2 offset = axis == 0 ? ivec2(1, 0) : ivec2(0, 1);
+		ivec2 prev = clamp(pixel - offset, ivec2(0), size - 1);
+		ivec2 next = clamp(pixel + offset, ivec2(0), size - 1);
+
+		if (texelFetch(edge_object, prev, 0).r != object || texelFetch(edge_object, next, 0).r != object) return true;
+		if (object == 0) continue;
+
+		vec4 geometry_prev = texelFetch(edge_geometry, prev, 0);
+		vec4 geometry_next = texelFetch(edge_geometry, next, 0);
+		if (dot(geometry.xyz, geometry_prev.xyz) < EDGE_NORMAL_COS || dot(geometry.xyz, geometry_next.xyz) < EDGE_NORMAL_COS) return true;
+
+		// the distance changes almost linearly across a smooth surface, so a step shows in the second difference
+		if (abs(geometry_prev.w + geometry_next.w - 2.0f * geometry.w) > EDGE_DEPTH_RATIO * geometry.w) return true;
+	}
 
-	vec2 sample_pos = pixel_position.xy + pixel_size * gl_SamplePosition;
+	return false;
+}
+
+float radical_inverse(uint index, const in uint base)
+{
+	float result = 0.0f;
+	float digit = 1.0f / float(base);
+	for (; index > 0; index /= base, digit /= float(base)) result += digit * float(index % base);
+	return result;
+}
+
+// The transmitted and reflected rays of a hit, each with a flag whether it carries enough light to be traced.
+void spawn_rays(const in Ray ray, const in vec3 hit_pos, const in vec3 hit_normal, const in Material hit_material, const in bool backface,
+				out Ray trans_ray, out bool has_trans, out Ray refl_ray, out bool has_refl)
+{
+	bool total_reflection;
+	has_trans = false;
+	has_refl = false;
+
+	// both children start with the cone's width at the hit and keep its spread, surfaces are taken as flat
+	vec2 cone = vec2(cone_width(ray, distance(ray.origin, hit_pos)), ray.cone.y);
+
+#if SCENE_TRANSMISSION
+	if (hit_material.diffuse.a < 0.99f)
+	{
+		if (backface) trans_ray.color_mult = ray.color_mult;
+		else trans_ray.color_mult = ray.color_mult * hit_material.diffuse.rgb * (1.0f - hit_material.diffuse.a);
+		
+		if (hit_material.eta != 1.0f)
+		{
+			if (backface) trans_ray.direction = refract(ray.direction, -hit_normal, 1.0f / hit_material.eta);
+			else trans_ray.direction = refract(ray.direction, hit_normal, hit_material.eta);
+			total_reflection = abs(trans_ray.direction.x) + abs(trans_ray.direction.y) + abs(trans_ray.direction.z) < 0.5f;
+		}
+		else
+		{
+			trans_ray.direction = ray.direction;
+			total_reflection = false;
+		}
+
+		if (!total_reflection && keep_ray(trans_ray.color_mult, ray.depth + 1, hit_pos, 2u * frame_index))
+		{
+			if (backface) trans_ray.origin = hit_pos + EPSILON * hit_normal;
+			else trans_ray.origin = hit_pos - EPSILON * hit_normal;
+			trans_ray.depth = ray.depth + 1;
+			trans_ray.transmitted = true;
+			trans_ray.cone = cone;
+			has_trans = true;
+		}
+	}
+	else total_reflection = true;
+#else
+	total_reflection = true;
+#endif
+
+	if (hit_material.reflective.r + hit_material.reflective.g + hit_material.reflective.b > 0.01f)
+	{
+
+		vec3 schlick_reflectivity = hit_material.reflective;
+		if (!total_reflection)
+		{
+			float normal_refl = (hit_material.eta - 1.0f) / (hit_material.eta + 1.0f);
+			schlick_reflectivity *= normal_refl * normal_refl;
+			float refl_scale = 1.0f - abs(dot(hit_normal, ray.direction));
+			schlick_reflectivity += (1.0f - schlick_reflectivity) * (refl_scale * refl_scale * refl_scale * refl_scale * refl_scale);
+		}
+		refl_ray.color_mult = ray.color_mult * mix(schlick_reflectivity, hit_material.reflective, hit_material.diffuse.a);
+
+		if (backface)
+		{
+			refl_ray.origin = hit_pos - EPSILON * hit_normal;
+			refl_ray.direction = reflect(ray.direction, -hit_normal);
+		}
+		else
+		{
+			refl_ray.origin = hit_pos + EPSILON * hit_normal;
+			refl_ray.direction = reflect(ray.direction, hit_normal);
+		}
+
+		if (keep_ray(refl_ray.color_mult, ray.depth + 1, hit_pos, 2u * frame_index + 1u))
+		{
+			refl_ray.depth = ray.depth + 1;
+			refl_ray.transmitted = ray.transmitted;
+			refl_ray.cone = cone;
+			has_refl = true;
+		}
+	}
+}
+
+#if STOCHASTIC_PATHS
+uint rng_state = 0u;
+
+// PCG hash of the state, uniform in [0, 1)
+float random()
+{
+	rng_state = rng_state * 747796405u + 2891336453u;
+	uint word = ((rng_state >> ((rng_state >> 28u) + 4u)) ^ rng_state) * 277803737u;
+	return float(((word >> 22u) ^ word) >> 8u) * (1.0f / 16777216.0f);
+}
+#endif
+
+// traces the ray through sample_pos (in image coordinates) and returns its color together with its primary hit
+vec3 trace_sample(const in vec2 sample_pos, out vec4 geometry, out uint object)
+{
+	vec3 color = vec3(0.0f);
+	geometry = vec4(0.0f);
+	object = 0;
 
 	Ray start_ray;
 	start_ray.origin = cam_pos;
@@ -487,87 +459,156 @@ void main()
 	start_ray.color_mult = vec3(1.0f);
 	start_ray.depth = 0;
 	start_ray.transmitted = false;
+	// a point at the eye, spreading by the angle of a pixel, or of all render pixels a reduced secondary pixel covers
+	float spread = pixel_size.y * length(img_up) / distance(ray_target, cam_pos);
+#if LOW_RES_SECONDARY
+	if (sampling == SAMPLING_SECONDARY) spread *= float(secondary_downscale);
+#endif
+	start_ray.cone = vec2(0.0f, spread);
 
+	vec3 hit_pos, hit_normal, hit_color = vec3(0.0f);
+	uint hit_object;
+	Material hit_material;
+	bool backface, has_trans, has_refl;
+	Ray trans_ray, refl_ray;
+
+#if STOCHASTIC_PATHS
+	// One path through the ray tree: every hit continues with either its transmitted or its reflected ray,
+	// picked in proportion to the light they carry and weighted by the inverse of that probability, so the
+	// mean over frames is the color of the whole tree.
+	Ray ray = start_ray;
+	for (uint depth = 0; depth < RECURSION_DEPTH; depth++)
+	{
+		if (!cast_ray(ray, hit_color, hit_pos, hit_object, hit_normal, hit_material, backface)) break;
+
+		if (depth == 0)
+		{
+			geometry = vec4(geometric_normal(hit_object, hit_pos), distance(hit_pos, cam_pos));
+			object = edge_object_class(hit_object);
+		}
+
+		if (!backface) color += ray.color_mult * hit_color;
+#if TEMPORAL_CACHE
+		if (depth == 0 && reuse_secondary(hit_pos, geometry, object, color)) break;
+#endif
+#if LOW_RES_SECONDARY
+		if (depth == 0 && upsample_secondary(sample_pos, geometry, object, color)) break;
+#endif
+
+		if (ray.depth >= RECURSION_DEPTH - 1) break;
+
+		spawn_rays(ray, hit_pos, hit_normal, hit_material, backface, trans_ray, has_trans, refl_ray, has_refl);
+		float trans_weight = has_trans ? dot(trans_ray.color_mult, vec3(1.0f)) : 0.0f;
+		float refl_weight = has_refl ? dot(refl_ray.color_mult, vec3(1.0f)) : 0.0f;
+		float total_weight = trans_weight + refl_weight;
+		if (total_weight <= 0.0f) break;
+
+		if (random() * total_weight < trans_weight)
+		{
+			ray = trans_ray;
+			ray.color_mult *= total_weight / trans_weight;
+		}
+		else
+		{
+			ray = refl_ray;
+			ray.color_mult *= total_weight / refl_weight;
+		}
+	}
+#else
+	// the whole ray tree, breadth first
 	Ray rays[MAX_RAYS];
 	uint next_ray = 1;
 	for (uint i = 1; i < MAX_RAYS; i++) rays[i].depth = -1;
 	rays[0] = start_ray;
 
-	vec3 hit_pos, hit_normal, hit_color = vec3(0.0f);
-	Material hit_material;
-	bool backface, total_reflection;
-	Ray ray, trans_ray, refl_ray;
+	Ray ray;
 
 	for (uint i = 0; i < MAX_RAYS; i++)
 	{
 		ray = rays[i];
 		if (ray.depth < 0) break;
-		if (!cast_ray(ray, hit_color, hit_pos, hit_normal, hit_material, backface)) continue;
+		if (!cast_ray(ray, hit_color, hit_pos, hit_object, hit_normal, hit_material, backface)) continue;
+
+		if (i == 0)
+		{
+			geometry = vec4(geometric_normal(hit_object, hit_pos), distance(hit_pos, cam_pos));
+			object = edge_object_class(hit_object);
+		}
 
 		if (!backface) color += ray.color_mult * hit_color;
+#if TEMPORAL_CACHE
+		if (i == 0 && reuse_secondary(hit_pos, geometry, object, color)) break;
+#endif
+#if LOW_RES_SECONDARY
+		if (i == 0 && upsample_secondary(sample_pos, geometry, object, color)) break;
+#endif
 
 		if (ray.depth >= RECURSION_DEPTH - 1 || next_ray >= MAX_RAYS) continue;
 
-		if (hit_material.diffuse.a < 0.99f)
-		{
-			if (backface) trans_ray.color_mult = ray.color_mult;
-			else trans_ray.color_mult = ray.color_mult * hit_material.diffuse.rgb * (1.0f - hit_material.diffuse.a);
-			
-			if (hit_material.eta != 1.0f)
-			{
-				if (backface) trans_ray.direction = refract(ray.direction, -hit_normal, 1.0f / hit_material.eta);
-				else trans_ray.direction = refract(ray.direction, hit_normal, hit_material.eta);
-				total_reflection = abs(trans_ray.direction.x) + abs(trans_ray.direction.y) + abs(trans_ray.direction.z) < 0.5f;
-			}
-			else
-			{
-				trans_ray.direction = ray.direction;
-				total_reflection = false;
-			}
+		spawn_rays(ray, hit_pos, hit_normal, hit_material, backface, trans_ray, has_trans, refl_ray, has_refl);
+		if (has_trans) rays[next_ray++] = trans_ray;
+		if (has_refl && next_ray < MAX_RAYS) rays[next_ray++] = refl_ray;
+	}
+#endif
 
-			if (!total_reflection && trans_ray.color_mult.r + trans_ray.color_mult.g + trans_ray.color_mult.b > 0.01f)
-			{
-				if (backface) trans_ray.origin = hit_pos + EPSILON * hit_normal;
-				else trans_ray.origin = hit_pos - EPSILON * hit_normal;
-				trans_ray.depth = ray.depth + 1;
-				trans_ray.transmitted = true;
-				rays[next_ray++] = trans_ray;
-			}
-		}
-		else total_reflection = true;
+	return color;
+}
 
-		if (next_ray < MAX_RAYS && hit_material.reflective.r + hit_material.reflective.g + hit_material.reflective.b > 0.01f)
-		{
+void main()
+{
+	vec4 geometry;
+	uint object;
 
-			vec3 schlick_reflectivity = hit_material.reflective;
-			if (!total_reflection)
-			{
-				float normal_refl = (hit_material.eta - 1.0f) / (hit_material.eta + 1.0f);
-				schlick_reflectivity *= normal_refl * normal_refl;
-				float refl_scale = 1.0f - abs(dot(hit_normal, ray.direction));
-				schlick_reflectivity += (1.0f - schlick_reflectivity) * (refl_scale * refl_scale * refl_scale * refl_scale * refl_scale);
-			}
-			refl_ray.color_mult = ray.color_mult * mix(schlick_reflectivity, hit_material.reflective, hit_material.diffuse.a);
+#if STOCHASTIC_PATHS
+	// a different sequence for every pixel, sample and frame
+	rng_state = (uint(gl_FragCoord.y) * 65536u + uint(gl_FragCoord.x)) * 16u + uint(gl_SampleID);
+	rng_state ^= frame_index * 2654435761u;
+	random();
+#endif
 
-			if (backface)
-			{
-				refl_ray.origin = hit_pos - EPSILON * hit_normal;
-				refl_ray.direction = reflect(ray.direction, -hit_normal);
-			}
-			else
-			{
-				refl_ray.origin = hit_pos + EPSILON * hit_normal;
-				refl_ray.direction = reflect(ray.direction, hit_normal);
-			}
+	if (sampling == SAMPLING_EDGE_REFINE)
+	{
+		if (!is_edge(ivec2(gl_FragCoord.xy))) discard;
+		atomicCounterIncrement(edge_pixel_count);
 
-			if (refl_ray.color_mult.r + refl_ray.color_mult.g + refl_ray.color_mult.b > 0.01f)
-			{
-				refl_ray.depth = ray.depth + 1;
-				refl_ray.transmitted = ray.transmitted;
-				rays[next_ray++] = refl_ray;
-			}
+		// the base pass took the center, these continue its Halton (2, 3) sequence;
+		// blending weighs the mean by edge_samples / (edge_samples + 1) against the center sample
+		vec3 color = vec3(0.0f);
+		for (uint i = 1; i <= uint(edge_samples); i++)
+		{
+			vec2 offset = vec2(radical_inverse(i, 2), radical_inverse(i, 3)) - 0.5f;
+			color += trace_sample(pixel_position.xy + pixel_size * offset, geometry, object);
 		}
+		fragColor = vec4(color / float(edge_samples), 1.0f);
+		return;
 	}
 
+#if LOW_RES_SECONDARY
+	if (sampling == SAMPLING_SECONDARY)
+	{
+		// the reduced pixel's center, in render pixels
+		vec3 color = trace_sample(gl_FragCoord.xy * float(secondary_downscale) * pixel_size, geometry, object);
+		fragColor = vec4(color - primary_color, 1.0f);
+		fragGeometry = geometry;
+		fragObject = object;
+		return;
+	}
+#endif
+
+	// the visibility buffer and the history hold one sample per pixel, the one of the single-sample modes
+#if VISIBILITY_BUFFER
+	primary_visible = sampling != SAMPLING_MULTISAMPLE;
+#endif
+#if TEMPORAL_CACHE
+	temporal_sample = sampling != SAMPLING_MULTISAMPLE;
+#endif
+
+	vec2 offset = sampling == SAMPLING_MULTISAMPLE ? gl_SamplePosition : (sampling == SAMPLING_JITTER ? jitter : vec2(0.0f));
+	vec3 color = trace_sample(pixel_position.xy + pixel_size * offset, geometry, object);
+#if TEMPORAL_CACHE
+	if (temporal_sample) store_history(color, geometry, object);
+#endif
 	fragColor = vec4(color, 1.0f);
+	fragGeometry = geometry;
+	fragObject = object;
 }
\ No newline at end of file
@@ -0,0 +1,564 @@
+// Scene description, intersection and material code shared by Raytrace.frag and the wavefront kernels.
+// Included after the #version line; uses buffer bindings 0-3 and 8.
+
+// defines GL_ARB_bindless_texture where the driver has it
+#extension GL_ARB_bindless_texture : enable
+
+const float INFINITY = uintBitsToFloat(0x7F800000);
+const float EPSILON = 1e-4f;
+const float PI = 3.14159265359f;
+const float TWOPI = 2.0f * PI;
+
+// Scene features; Shader injects 0 for the ones a scene does not use, so their code is compiled out.
+// MAX_RAYS is the ray stack of a pixel: a ray spawns up to two children, but only one without transmission.
+#ifndef SCENE_SPHERES
+#define SCENE_SPHERES 1
+#endif
+#ifndef SCENE_TRANSMISSION
+#define SCENE_TRANSMISSION 1
+#endif
+#ifndef SCENE_NORMAL_MAPS
+#define SCENE_NORMAL_MAPS 1
+#endif
+#ifndef RECURSION_DEPTH
+#define RECURSION_DEPTH 5u
+#endif
+#ifndef MAX_RAYS
+#define MAX_RAYS 31u
+#endif
+
+// intersection kernel variants, same as HitMode and FaceMode of the CPU tracer;
+// call sites pass them as literals so every inlined kernel is specialized by the compiler
+#define HIT_CLOSEST 0
+#define HIT_ANY 1
+#define FACES_BOTH 0
+#define FACES_FRONT 1
+#define FACES_BACK 2
+
+struct Ray
+{
+	vec3 origin;
+	vec3 direction;
+	vec3 color_mult;
+	int depth;
+	bool transmitted;
+	// ray cone: width at the origin and spread angle, which give the texture footprint at a hit
+	vec2 cone;
+};
+
+struct Material
+{
+	vec3 ambient;
+	vec4 diffuse;
+	vec4 specular;
+	vec3 emissive;
+	vec3 reflective;
+	ivec4 textures;
+	int normalmap;
+	float eta;
+};
+
+struct Vertex
+{
+	vec3 position;
+	vec3 normal;
+	vec2 uv;
+	Material material;
+};
+
+struct Triangle
+{
+	uvec3 indices;
+	vec3 normal;
+	mat2 uvtrans;
+	// first vertex position and the edges to the other two
+	vec3 vertex;
+	vec3 edge1;
+	vec3 edge2;
+};
+
+struct Light
+{
+	int type;
+	vec3 position;
+	vec3 direction;
+	vec3 color;
+	float intensity;
+};
+
+struct Sphere
+{
+	vec4 definition;
+	Material material;
+};
+
+uniform vec4 ground_plane;
+
+// Textures are addressed through their slot, see TextureSet: either a bindless handle (when bindless_textures
+// is set) or a layer of one of the texture arrays, which group the textures by size.
+#define MAX_TEXTURE_ARRAYS 8
+
+struct TextureSlot
+{
+	uvec2 handle;
+	int array;
+	int layer;
+};
+
+uniform sampler2DArray texture_arrays[MAX_TEXTURE_ARRAYS];
+#ifdef GL_ARB_bindless_texture
+uniform bool bindless_textures;
+#endif
+
+
+layout(std430, binding = 0) buffer LightBuffer
+{
+	Light lights[];
+};
+
+layout(std430, binding = 1) buffer SphereBuffer
+{
+	Sphere spheres[];
+};
+
+layout(std430, binding = 2) buffer VertexBuffer
+{
+	Vertex vertices[];
+};
+
+layout(std430, binding = 8) buffer TextureSlotBuffer
+{
+	TextureSlot texture_slots[];
+};
+
+layout(std430, binding = 3) buffer TriangleBuffer
+{
+	Triangle triangles[];
+};
+
+
+float max_axis(const in vec3 v)
+{
+	vec3 vabs = abs(v);
+	return max(vabs.x, max(vabs.y, vabs.z));
+}
+
+bool face_accepted(const in int faces, const in bool backface)
+{
+	return faces == FACES_BOTH || (faces == FACES_FRONT ? !backface : backface);
+}
+
+bool plane_intersect(const in vec4 plane, const in Ray ray, const in int faces, out float t, out bool backface)
+{
+	float dn = dot(ray.direction, plane.xyz);
+	backface = dn > -EPSILON;
+	if (!face_accepted(faces, backface)) return false;
+	float en = dot(ray.origin, plane.xyz);
+	t = (plane.w - en) / dn;
+	return true;
+}
+
+// HIT_CLOSEST returns the nearest intersection in front of the origin, HIT_ANY the far one for shadow rays
+bool sphere_intersect(const in Sphere sphere, const in Ray ray, const in int mode, const in int faces, out float t, out bool backface)
+{
+	float t0, t1;
+	vec3 L = ray.origin - sphere.definition.xyz;
+
+	float c = (-sphere.definition.w * sphere.definition.w) + dot(L, L);
+	backface = c < 0.0f;
+	if (!face_accepted(faces, backface)) return false;
+
+	float cosangle = dot(ray.direction, -L);
+
+	if (!backface)
+	{
+		float limit = (sphere.definition.w / -3.0f) + length(L);
+		if (cosangle < limit) return false;
+	}
+
+	float a = dot(ray.direction, ray.direction);
+	float b = -2.0f * cosangle;
+	// solve quadratic function
+	float discr = b*b - 4.0f * a * c;
+	if (discr < 0.0f)
+		return false;
+	else if (discr == 0.0f)
+	{
+		t0 = -0.5f * b / a;
+		t1 = t0;
+	}
+	else
+	{
+		float q = (b > 0) ? -0.5f * (b + sqrt(discr)) : -0.5f * (b - sqrt(discr));
+		t0 = q / a;
+		t1 = c / q;
+	}
+
+	if (t0 > t1)
+	{
+		float temp = t0;
+		t0 = t1;
+		t1 = temp;
+	}
+
+	if (t0 < 0)
+	{
+		t0 = t1; // use t1 if t0 is negative
+		if (t0 < 0) return false; // both negative
+	}
+
+	t = mode == HIT_CLOSEST ? t0 : t1;
+	return true;
+}
+
+// Moller-Trumbore test on the triangle's precomputed edges. Its first rejection costs less than the bounding
+// sphere test that used to precede it, so every triangle goes straight to it.
+bool triangle_intersect(const in Triangle triangle, const in Ray ray, const in int faces, out float t, out vec3 hit_bary, out bool backface)
+{
+	backface = dot(ray.direction, triangle.normal) > -EPSILON;
+	if (!face_accepted(faces, backface)) return false;
+
+	vec3 pvec = cross(ray.direction, triangle.edge2);
+	float inv_det = 1.0f / dot(triangle.edge1, pvec);
+
+	vec3 tvec = ray.origin - triangle.vertex;
+	hit_bary.y = dot(tvec, pvec) * inv_det;
+	if (hit_bary.y < 0.0f || hit_bary.y > 1.0f) return false;
+
+	vec3 qvec = cross(tvec, triangle.edge1);
+	hit_bary.z = dot(ray.direction, qvec) * inv_det;
+	if (hit_bary.z < 0.0f || hit_bary.y + hit_bary.z > 1.0f) return false;
+	hit_bary.x = 1.0f - hit_bary.y - hit_bary.z;
+
+	t = dot(triangle.edge2, qvec) * inv_det;
+	return true;
+}
+
+// smallest cosine of the incidence angle a footprint is stretched by, grazing hits would select the last level
+const float MIN_CONE_COS = 1.0f / 16.0f;
+
+float cone_width(const in Ray ray, const in float t)
+{
+	return ray.cone.x + ray.cone.y * t;
+}
+
+// Width in texture coordinates of a cone of the given width at a surface with uv_per_unit texture coordinates per
+// world unit; the footprint stretches by 1 / cos of the incidence angle.
+float uv_footprint(const in float cone_width, const in vec3 direction, const in vec3 normal, const in float uv_per_unit)
+{
+	return cone_width * uv_per_unit / max(abs(dot(direction, normal)), MIN_CONE_COS);
+}
+
+float texture_lod(const in ivec2 size, const in float uv_width)
+{
+	return log2(max(uv_width * float(max(size.x, size.y)), 1.0f));
+}
+
+// Sampler arrays may only be indexed with dynamically uniform values, which the rays of a wavefront work group
+// (or of a fragment quad) are not, so the array is selected with constant indices. The level comes from the ray
+// cone rather than derivatives, which mean nothing after the first bounce and do not exist in the wavefront kernels.
+#define SAMPLE_TEXTURE(sampler, coord) textureLod(sampler, coord, texture_lod(textureSize(sampler, 0).xy, uv_width))
+#define TEXTURE_ARRAY_CASE(i) case i: return SAMPLE_TEXTURE(texture_arrays[i], coord);
+
+// uv_width is the footprint of the lookup in texture coordinates, 0 for the base level
+vec4 sample_texture(const in int index, const in vec2 uv, const in float uv_width)
+{
+	TextureSlot slot = texture_slots[index];
+
+#ifdef GL_ARB_bindless_texture
+	if (bindless_textures) return SAMPLE_TEXTURE(sampler2D(slot.handle), uv);
+#endif
+
+	vec3 coord = vec3(uv, float(slot.layer));
+	switch (slot.array)
+	{
+		TEXTURE_ARRAY_CASE(0) TEXTURE_ARRAY_CASE(1) TEXTURE_ARRAY_CASE(2) TEXTURE_ARRAY_CASE(3)
+		TEXTURE_ARRAY_CASE(4) TEXTURE_ARRAY_CASE(5) TEXTURE_ARRAY_CASE(6) TEXTURE_ARRAY_CASE(7)
+	}
+	return vec4(0.0f);
+}
+
+// cone_width is the width of the ray's cone at the hit, 0 samples the textures at their base level
+void get_object_properties(const in uint object, const in vec3 position, const in vec3 bary, const in vec3 direction, const in float cone_width,
+						   out Material mat, out vec3 normal)
+{
+	vec2 uv = vec2(0.0f);
+	float uv_width;
+
+	if (object == 0) //ground plane
+	{
+		mat.diffuse = vec4(1.0f);
+		mat.ambient = mat.diffuse.xyz;
+		mat.specular = vec4(1.0f, 1.0f, 1.0f, 40.0f);
+		mat.emissive = mat.ambient / 15.0f;
+		mat.reflective = vec3(0.0f);
+		mat.textures = ivec4(0, -1, 0, -1);
+		uv = (position.xz / 10.0f) - .25f;
+		vec3 snormal = ground_plane.xyz;
+		uv_width = uv_footprint(cone_width, direction, snormal, 0.1f);
+		vec3 tanx, tany;
+		if (snormal.x == 0.0f && snormal.z == 0.0f)
+		{
+			tanx = vec3(1.0f, 0.0f, 0.0f);
+			tany = vec3(0.0f, 0.0f, 1.0f);
+		}
+		else
+		{
+			tanx = cross(vec3(0.0f, 1.0f, 0.0f), snormal);
+			tany = cross(snormal, tanx);
+		}
+		vec3 map_normal = 2.0f * sample_texture(1, uv, uv_width).xyz - 1.0f;
+		normal = normalize(map_normal.x * tanx + map_normal.y * tany + map_normal.z * snormal);
+		//normal = snormal;
+	}
+#if SCENE_SPHERES
+	else if (object <= spheres.length()) //sphere
+	{
+		Sphere sphere = spheres[object - 1];
+		mat = sphere.material;
+		vec3 snormal = normalize(position - sphere.definition.xyz);
+		uv = vec2(asin(snormal.x) / TWOPI, acos(snormal.y) / PI);
+		// v runs over half a great circle
+		uv_width = uv_footprint(cone_width, direction, snormal, 1.0f / (PI * sphere.definition.w));
+		normal = snormal;
+#if SCENE_NORMAL_MAPS
+		if (mat.normalmap < 0) normal = snormal;
+		else
+		{
+			vec3 tanx, tany;
+			if (snormal.x == 0.0f && snormal.z == 0.0f)
+			{
+				tanx = vec3(1.0f, 0.0f, 0.0f);
+				tany = vec3(0.0f, 0.0f, 1.0f);
+			}
+			else
+			{
+				tanx = cross(vec3(0.0f, 1.0f, 0.0f), snormal);
+				tany = cross(snormal, tanx);
+			}
+			vec3 map_normal = 2.0f * sample_texture(mat.normalmap, uv, uv_width).xyz - 1.0f;
+			normal = normalize(map_normal.x * tanx + map_normal.y * tany + map_normal.z * snormal);
+		}
+#endif
+	}
+#endif
+	else
+	{
+		Triangle tri = triangles[object - spheres.length() - 1];
+		Vertex vert1 = vertices[tri.indices.x];
+		Vertex vert2 = vertices[tri.indices.y];
+		Vertex vert3 = vertices[tri.indices.z];
+
+		mat.ambient = bary.x * vert1.material.ambient + bary.y * vert2.material.ambient + bary.z * vert3.material.ambient;
+		mat.diffuse = bary.x * vert1.material.diffuse + bary.y * vert2.material.diffuse + bary.z * vert3.material.diffuse;
+		mat.specular = bary.x * vert1.material.specular + bary.y * vert2.material.specular + bary.z * vert3.material.specular;
+		mat.emissive = bary.x * vert1.material.emissive + bary.y * vert2.material.emissive + bary.z * vert3.material.emissive;
+		mat.reflective = bary.x * vert1.material.reflective + bary.y * vert2.material.reflective + bary.z * vert3.material.reflective;
+		mat.textures = vert1.material.textures;
+		mat.normalmap = vert1.material.normalmap;
+		mat.eta = bary.x * vert1.material.eta + bary.y * vert2.material.eta + bary.z * vert3.material.eta;
+
+		uv = bary.x * vert1.uv + bary.y * vert2.uv + bary.z * vert3.uv;
+
+		vec3 snormal = normalize(bary.x * vert1.normal + bary.y * vert2.normal + bary.z * vert3.normal);
+		vec2 uv_edge1 = vert2.uv - vert1.uv;
+		vec2 uv_edge2 = vert3.uv - vert1.uv;
+		float uv_area = abs(uv_edge1.x * uv_edge2.y - uv_edge1.y * uv_edge2.x);
+		uv_width = uv_footprint(cone_width, direction, snormal, sqrt(uv_area / length(cross(tri.edge1, tri.edge2))));
+#if SCENE_NORMAL_MAPS
+		if (mat.normalmap < 0 || tri.uvtrans == mat2(0.0f, 0.0f, 0.0f, 0.0f)) normal = snormal;
+		else
+		{
+			vec3 bar1 = vert2.position - vert1.position;
+			vec3 bar2 = vert3.position - vert1.position;
+
+			vec3 map_normal = 2.0f * sample_texture(mat.normalmap, uv, uv_width).xyz - 1.0f;
+
+			vec2 transformed_xy = tri.uvtrans * map_normal.xy;
+
+			normal = normalize(transformed_xy.x * bar1 + transformed_xy.y * bar2 + map_normal.z * snormal);
+		}
+#else
+		normal = snormal;
+#endif
+	}
+
+	if (mat.textures.x >= 0)
+	{
+		vec4 texVal = sample_texture(mat.textures.x, uv, uv_width);
+		mat.ambient *= texVal.rgb;
+		mat.diffuse *= texVal;
+	}
+	if (mat.textures.y >= 0) mat.specular.xyz *= sample_texture(mat.textures.y, uv, uv_width).rgb;
+	if (mat.textures.z >= 0) mat.emissive *= sample_texture(mat.textures.z, uv, uv_width).rgb;
+	if (mat.textures.w >= 0) mat.reflective *= sample_texture(mat.textures.w, uv, uv_width).rgb;
+}
+
+vec3 phong_lighting(const in vec3 view_dir, const in vec3 normal, const in Material material,
+					const in vec3 light_dir, const in vec3 light_color, const in float light_intensity)
+{
+	vec3 result = material.ambient * light_color * light_intensity;
+
+	float normal_dot_light_dir = dot(normal, -light_dir);
+
+	if (normal_dot_light_dir > 0.0f)
+	{
+		result += material.diffuse.rgb * light_color * (light_intensity * normal_dot_light_dir);
+
+		float reflection_dot_view = dot(reflect(light_dir, normal), view_dir);
+		if (reflection_dot_view > 0)
+		{
+			result += material.specular.rgb * light_color * (light_intensity * pow(reflection_dot_view, material.specular.w));
+		}
+	}
+
+	return result * material.diffuse.a;
+}
+
+bool trace_faces(const in Ray ray, const in int faces, out float t, out vec3 hit_pos, out uint hit_object, out vec3 hit_bary, out bool backface)
+{
+	t = INFINITY;
+	bool hit = false;
+	hit_bary = vec3(0.0f);
+	backface = false;
+
+	float t_obj;
+	bool obj_backface;
+	vec3 obj_bary;
+
+	if (plane_intersect(ground_plane, ray, faces, t_obj, obj_backface) && t_obj < t && t_obj > 0.0f)
+	{
+		t = t_obj;
+		hit_pos = ray.origin + t * ray.direction;
+		hit = true;
+		hit_object = 0;
+		backface = obj_backface;
+	}
+
+#if SCENE_SPHERES
+	for (uint i = 0; i < spheres.length(); i++)
+	{
+		Sphere sphere = spheres[i];
+		if (sphere.definition.w < EPSILON) continue;
+
+		if (sphere_intersect(sphere, ray, HIT_CLOSEST, faces, t_obj, obj_backface) && t_obj < t && t_obj > 0.0f)
+		{
+			t = t_obj;
+			hit_pos = ray.origin + t * ray.direction;
+			hit = true;
+			hit_object = i + 1;
+			backface = obj_backface;
+		}
+	}
+#endif
+
+	for (uint i = 0; i < triangles.length(); i++)
+	{
+		Triangle triangle = triangles[i];
+		
+		if (triangle_intersect(triangle, ray, faces, t_obj, obj_bary, obj_backface) && t_obj < t && t_obj > 0.0f)
+		{
+			t = t_obj;
+			hit_pos = ray.origin + t * ray.direction;
+			hit = true;
+			hit_object = i + spheres.length() + 1;
+			hit_bary = obj_bary;
+			backface = obj_backface;
+		}
+	}
+
+	return hit;
+}
+
+bool trace(const in Ray ray, out float t, out vec3 hit_pos, out uint hit_object, out vec3 hit_bary, out bool backface)
+{
+	// transmitted rays travel inside objects and must see backfaces, all others cull them
+	if (ray.transmitted) return trace_faces(ray, FACES_BOTH, t, hit_pos, hit_object, hit_bary, backface);
+	return trace_faces(ray, FACES_FRONT, t, hit_pos, hit_object, hit_bary, backface);
+}
+
+// attenuates color_mult by the surface a shadow ray passes, returns false once no light gets through
+bool shadow_transmit(const in uint object, const in vec3 hit_pos, const in vec3 hit_bary, inout vec3 color_mult)
+{
+#if SCENE_TRANSMISSION
+	vec3 hit_normal;
+	Material hit_mat;
+	// shadow rays only read the transmission of what they pass, from the base level
+	get_object_properties(object, hit_pos, hit_bary, vec3(0.0f), 0.0f, hit_mat, hit_normal);
+	color_mult *= hit_mat.diffuse.rgb * (1.0f - hit_mat.diffuse.a);
+	return !(color_mult.r + color_mult.g + color_mult.b < 0.01f);
+#else
+	// every surface is opaque, so the first hit blocks the light without looking at its material
+	color_mult = vec3(0.0f);
+	return false;
+#endif
+}
+
+bool shadow_trace(const in Ray ray, out vec3 color_mult)
+{
+	vec3 hit_bary = vec3(0.0f);
+
+	color_mult = vec3(1.0f);
+
+	float t_obj;
+	bool obj_backface;
+
+	if (plane_intersect(ground_plane, ray, FACES_BACK, t_obj, obj_backface) && t_obj < 1.0f && t_obj > 0.0f)
+	{
+		if (!shadow_transmit(0, ray.origin + t_obj * ray.direction, hit_bary, color_mult)) return false;
+	}
+
+#if SCENE_SPHERES
+	for (uint i = 0; i < spheres.length(); i++)
+	{
+		Sphere sphere = spheres[i];
+		if (sphere.definition.w < EPSILON) continue;
+
+		if (sphere_intersect(sphere, ray, HIT_ANY, FACES_BOTH, t_obj, obj_backface) && t_obj < 1.0f && t_obj > 0.0f)
+		{
+			if (!shadow_transmit(i + 1, ray.origin + t_obj * ray.direction, hit_bary, color_mult)) return false;
+		}
+	}
+#endif
+
+	for (uint i = 0; i < triangles.length(); i++)
+	{
+		Triangle triangle = triangles[i];
+		
+		if (triangle_intersect(triangle, ray, FACES_BACK, t_obj, hit_bary, obj_backface) && t_obj < 1.0f && t_obj > 0.0f)
+		{
+			if (!shadow_transmit(i + spheres.length() + 1, ray.origin + t_obj * ray.direction, hit_bary, color_mult)) return false;
+		}
+	}
+
+	return true;
+}
+
+// Ray depth from which spawned rays play Russian roulette, 0 for none. Without it a spawned ray is traced while the
+// sum of its throughput is above 0.01, which loses the light of all dimmer rays.
+uniform int roulette_depth;
+// largest throughput component from which a ray always survives
+const float ROULETTE_THROUGHPUT = 0.5f;
+
+uint pcg_hash(const in uint value)
+{
+	uint state = value * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+// Whether a ray of the given depth spawned at position is traced. From roulette_depth on it survives with a
+// probability proportional to its throughput, which is divided by that probability, so the mean over samples keeps
+// the light of every ray. The decision hashes the position with seed, which differs per frame and per branch.
+bool keep_ray(inout vec3 color_mult, const in int depth, const in vec3 position, const in uint seed)
+{
+	if (roulette_depth <= 0) return color_mult.r + color_mult.g + color_mult.b > 0.01f;
+	if (depth < roulette_depth) return max_axis(color_mult) > 0.0f;
+
+	float survival = min(max_axis(color_mult) / ROULETTE_THROUGHPUT, 1.0f);
+	uint hash = pcg_hash(seed ^ pcg_hash(floatBitsToUint(position.x) ^ pcg_hash(floatBitsToUint(position.y) ^ pcg_hash(floatBitsToUint(position.z)))));
+	if (float(hash >> 8u) * (1.0f / 16777216.0f) >= survival) return false;
+
+	color_mult /= survival;
+	return true;
+}
@@ -0,0 +1,127 @@
+#version 430
+
+#include "RaytraceCommon.glsl"
+#include "Frame.glsl"
+
+// Joint-bilateral upscaling of a reduced-size render, see BilateralUpscaler. Every window pixel blends the four
+// nearest render pixels with bilinear weights, each scaled by how well the surface seen through that render
+// pixel's center matches the one seen through the window pixel: their hit distances, normals and objects.
+
+layout(location = 0) out vec4 fragColor;
+
+uniform sampler2D source;
+// guides of the render size and of the window size, VisibilityBuffer targets
+uniform usampler2D low_object;
+uniform sampler2D low_depth;
+uniform usampler2D guide_object;
+uniform sampler2D guide_depth;
+uniform vec2 output_size;
+
+// relative hit distance difference at which a render pixel's weight falls to 1/e
+const float DEPTH_TOLERANCE = 0.05f;
+// sharpness of the normal weight, a power of the cosine
+const float NORMAL_POWER = 16.0f;
+// weight of a render pixel that sees another object, so that the sphere or triangle of a window pixel wins
+// wherever it was traced, while neighboring triangles of a mesh still blend
+const float OTHER_OBJECT_WEIGHT = 0.1f;
+// below this total weight no render pixel sees the window pixel's surface
+const float MIN_WEIGHT = 1e-4f;
+
+// the ground plane is not in the visibility buffer, it gets the object after the triangles
+const uint PLANE_OBJECT = 0xFFFFFFFFu;
+
+struct Surface
+{
+	// 0 for the background, t is infinite then
+	uint object;
+	float t;
+	vec3 normal;
+};
+
+// The closest of the ground plane and the guide's object along the ray through an image position in [0, 1]^2,
+// the same hit the tracer's primary ray finds.
+Surface surface_at(const in vec2 image_pos, const in uint object, const in float depth)
+{
+	Ray ray;
+	ray.origin = cam_pos;
+	ray.direction = normalize(img_origin + image_pos.x * img_right + image_pos.y * img_up - cam_pos);
+
+	Surface surface;
+	surface.object = object;
+	surface.t = object != 0 ? ldexp(depth, 32) : INFINITY;
+	surface.normal = vec3(0.0f);
+
+	float t_plane;
+	bool backface;
+	if (plane_intersect(ground_plane, ray, FACES_FRONT, t_plane, backface) && t_plane > 0.0f && t_plane < surface.t)
+	{
+		surface.object = PLANE_OBJECT;
+		surface.t = t_plane;
+		surface.normal = ground_plane.xyz;
+	}
+	else if (object != 0 && object <= spheres.length())
+	{
+		vec4 sphere = spheres[object - 1].definition;
+		surface.normal = normalize(ray.origin + surface.t * ray.direction - sphere.xyz);
+	}
+	else if (object != 0)
+	{
+		surface.normal = triangles[object - spheres.length() - 1].normal;
+	}
+	return surface;
+}
+
+// how well a render pixel's surface stands in for the window pixel's
+float guide_weight(const in Surface pixel, const in Surface candidate)
+{
+	if (pixel.object == 0 || candidate.object == 0) return pixel.object == candidate.object ? 1.0f : 0.0f;
+
+	float depth = abs(candidate.t - pixel.t) / (DEPTH_TOLERANCE * pixel.t);
+	float weight = exp(-depth * depth) * pow(max(dot(pixel.normal, candidate.normal), 0.0f), NORMAL_POWER);
+	return pixel.object == candidate.object ? weight : OTHER_OBJECT_WEIGHT * weight;
+}
+
+void main()
+{
+	ivec2 low_size = textureSize(source, 0);
+	vec2 image_pos = gl_FragCoord.xy / output_size;
+
+	ivec2 pixel_coord = ivec2(gl_FragCoord.xy);
+	Surface pixel = surface_at(image_pos, texelFetch(guide_object, pixel_coord, 0).r, texelFetch(guide_depth, pixel_coord, 0).r);
+
+	// the four render pixels around the window pixel's position, as bilinear filtering picks them
+	vec2 low_pos = image_pos * vec2(low_size) - 0.5f;
+	ivec2 base = ivec2(floor(low_pos));
+	vec2 f = low_pos - vec2(base);
+
+	vec3 color = vec3(0.0f);
+	vec3 bilinear_color = vec3(0.0f);
+	float total = 0.0f;
+	float best = 0.0f;
+	vec3 best_color = vec3(0.0f);
+	for (int i = 0; i < 4; i++)
+	{
+		ivec2 offset = ivec2(i & 1, i >> 1);
+		ivec2 coord = clamp(base + offset, ivec2(0), low_size - 1);
+		float bilinear = (offset.x == 1 ? f.x : 1.0f - f.x) * (offset.y == 1 ? f.y : 1.0f - f.y);
+
+		vec3 sample_color = texelFetch(source, coord, 0).rgb;
+		Surface sample_surface = surface_at((vec2(coord) + 0.5f) / vec2(low_size), texelFetch(low_object, coord, 0).r, texelFetch(low_depth, coord, 0).r);
+		float weight = guide_weight(pixel, sample_surface);
+
+		color += bilinear * weight * sample_color;
+		bilinear_color += bilinear * sample_color;
+		total += bilinear * weight;
+		if (weight > best)
+		{
+			best = weight;
+			best_color = sample_color;
+		}
+	}
+
+	// Falls back to the best matching render pixel when only far ones match, and to bilinear filtering when none
+	// does, such as for a thin object that no render pixel center hit.
+	if (total >= MIN_WEIGHT) color /= total;
+	else color = best > 0.0f ? best_color : bilinear_color;
+	fragColor = vec4(color, 1.0f);
+}
@@ -0,0 +1,37 @@
+#version 430
+
+#include "RaytraceCommon.glsl"
+#include "Frame.glsl"
+
+// the sphere or triangle of Visibility.vert that the pixel's primary ray hits first, 0 for none of them
+layout(location = 0) out uint fragObject;
+
+flat in uint object;
+
+// see Visibility.vert
+uniform vec2 guide_pixel_size;
+
+void main()
+{
+	// the ray of Raytrace.frag's single-sample modes, or through the pixel center of a guide
+	Ray ray;
+	vec2 sample_pos = guide_pixel_size.x > 0.0f ? gl_FragCoord.xy * guide_pixel_size : (gl_FragCoord.xy + jitter) * pixel_size;
+	vec3 ray_target = img_origin + sample_pos.x * img_right + sample_pos.y * img_up;
+	ray.origin = cam_pos;
+	ray.direction = normalize(ray_target - cam_pos);
+	ray.color_mult = vec3(1.0f);
+	ray.depth = 0;
+	ray.transmitted = false;
+
+	float t;
+	vec3 hit_bary;
+	bool backface, hit;
+	if (object <= spheres.length()) hit = sphere_intersect(spheres[object - 1], ray, HIT_CLOSEST, FACES_FRONT, t, backface);
+	else hit = triangle_intersect(triangles[object - spheres.length() - 1], ray, FACES_FRONT, t, hit_bary, backface);
+	if (!hit || !(t > 0.0f)) discard;
+
+	// Scaling by a power of two keeps every bit of the distance, so the depth test orders the hits exactly like
+	// trace_faces, and keeps the first one drawn on ties just as it keeps the first one tested.
+	gl_FragDepth = ldexp(t, -32);
+	fragObject = object;
+}
@@ -0,0 +1,143 @@
+#version 430
+
+#include "RaytraceCommon.glsl"
+#include "Frame.glsl"
+
+// Primary visibility of the hybrid fragment tracer, see VisibilityBuffer. Draws every sphere as a screen-space
+// quad of 6 vertices, then every triangle as 3 vertices, in the order trace_faces tests them. There are no
+// vertex attributes: the geometry is read from the scene buffers by gl_VertexID.
+
+flat out uint object;
+
+// Pixel size of a guide target, which samples the pixel centers of its own size; 0 samples the tracer's pixels
+// at the jitter of the Frame block.
+uniform vec2 guide_pixel_size;
+
+// Every primitive is widened by this many pixels, so that rasterization never misses a sample the exact
+// intersection test of Visibility.frag accepts; the extra fragments are discarded there.
+const float MARGIN = 0.125f;
+// the widest a sharp corner may move, in units of MARGIN
+const float MAX_MITER = 16.0f;
+// Vertices closer to the camera plane than this, in units of the image plane distance, have no usable
+// projection; their primitive covers the whole screen instead and is left to the intersection test.
+const float NEAR = 1e-3f;
+
+// outside the clip volume, a primitive made of it is dropped
+const vec4 CULLED = vec4(0.0f, 0.0f, 2.0f, 1.0f);
+
+vec2 target_pixel_size()
+{
+	return guide_pixel_size.x > 0.0f ? guide_pixel_size : pixel_size;
+}
+
+// Clip space position of a world position. w is the distance along the view axis in units of the image plane
+// distance, x and y map the image plane to [-w, w]. The rasterizer samples pixel centers, so everything moves
+// by -jitter to sample where the tracer's jittered rays go.
+vec4 project(const in vec3 position)
+{
+	vec3 to_origin = img_origin - cam_pos;
+	vec3 to_center = to_origin + 0.5f * (img_right + img_up);
+	vec3 offset = position - cam_pos;
+
+	float w = dot(offset, to_center) / dot(to_center, to_center);
+	vec3 on_plane = offset - w * to_origin;
+	vec2 image_pos = vec2(dot(on_plane, img_right) / dot(img_right, img_right), dot(on_plane, img_up) / dot(img_up, img_up));
+	if (guide_pixel_size.x == 0.0f) image_pos -= w * jitter * pixel_size;
+
+	return vec4(2.0f * image_pos - w, 0.0f, w);
+}
+
+// clip space position in pixels and back, for a vertex in front of the camera
+vec2 to_pixels(const in vec4 clip)
+{
+	return (0.5f * clip.xy / clip.w + 0.5f) / target_pixel_size();
+}
+
+vec4 from_pixels(const in vec2 pixels)
+{
+	return vec4(2.0f * pixels * target_pixel_size() - 1.0f, 0.0f, 1.0f);
+}
+
+// Moves the corner of a screen-space triangle so that both of its edges move outwards by MARGIN.
+vec2 widen_corner(const in vec2 prev, const in vec2 corner, const in vec2 next)
+{
+	vec2 edge_in = corner - prev;
+	vec2 edge_out = next - corner;
+	float area = edge_in.x * edge_out.y - edge_in.y * edge_out.x;
+	if (area == 0.0f) return corner;
+
+	// outward normals for counter-clockwise triangles, flipped for clockwise ones
+	vec2 normal_in = sign(area) * normalize(vec2(edge_in.y, -edge_in.x));
+	vec2 normal_out = sign(area) * normalize(vec2(edge_out.y, -edge_out.x));
+
+	// where the two moved edges meet
+	vec2 offset = MARGIN * (normal_in + normal_out) / max(1.0f + dot(normal_in, normal_out), 1.0f / MAX_MITER);
+	return corner + offset;
+}
+
+vec4 sphere_vertex(const in uint sphere_index, const in uint corner)
+{
+	Sphere sphere = spheres[sphere_index];
+	// trace_faces skips these
+	if (sphere.definition.w < EPSILON) return CULLED;
+
+	vec2 quad = vec2(corner == 1 || corner == 4 || corner == 5 ? 1.0f : 0.0f, corner == 2 || corner == 3 || corner == 5 ? 1.0f : 0.0f);
+
+	// the projected corners of the bounding box enclose the projected sphere
+	vec2 low = vec2(INFINITY);
+	vec2 high = vec2(-INFINITY);
+	for (int i = 0; i < 8; i++)
+	{
+		vec3 box_corner = sphere.definition.xyz + sphere.definition.w * vec3((i & 1) != 0 ? 1.0f : -1.0f, (i & 2) != 0 ? 1.0f : -1.0f, (i & 4) != 0 ? 1.0f : -1.0f);
+		vec4 clip = project(box_corner);
+		if (clip.w < NEAR) return vec4(2.0f * quad - 1.0f, 0.0f, 1.0f);
+
+		vec2 pixels = to_pixels(clip);
+		low = min(low, pixels);
+		high = max(high, pixels);
+	}
+
+	return from_pixels(mix(low - MARGIN, high + MARGIN, quad));
+}
+
+vec4 triangle_vertex(const in uint triangle_index, const in uint corner)
+{
+	Triangle triangle = triangles[triangle_index];
+	vec3 positions[3] = vec3[3](vertices[triangle.indices.x].position, vertices[triangle.indices.y].position, vertices[triangle.indices.z].position);
+
+	// Faces away from the camera everywhere, which the tracer culls for primary rays. The distance to the plane
+	// of the stored normal is linear, so it is positive all over the triangle if it is at the corners.
+	if (dot(positions[0] - cam_pos, triangle.normal) >= 0.0f && dot(positions[1] - cam_pos, triangle.normal) >= 0.0f &&
+		dot(positions[2] - cam_pos, triangle.normal) >= 0.0f) return CULLED;
+
+	vec4 clip[3] = vec4[3](project(positions[0]), project(positions[1]), project(positions[2]));
+	if (max(clip[0].w, max(clip[1].w, clip[2].w)) <= 0.0f) return CULLED;
+
+	if (min(clip[0].w, min(clip[1].w, clip[2].w)) < NEAR)
+	{
+		// one triangle over the whole screen
+		return vec4(corner == 1 ? 3.0f : -1.0f, corner == 2 ? 3.0f : -1.0f, 0.0f, 1.0f);
+	}
+
+	vec2 prev = to_pixels(clip[(corner + 2) % 3]);
+	vec2 next = to_pixels(clip[(corner + 1) % 3]);
+	return from_pixels(widen_corner(prev, to_pixels(clip[corner]), next));
+}
+
+void main()
+{
+	uint vertex = uint(gl_VertexID);
+	uint sphere_vertices = 6 * spheres.length();
+
+	if (vertex < sphere_vertices)
+	{
+		object = vertex / 6 + 1;
+		gl_Position = sphere_vertex(vertex / 6, vertex % 6);
+	}
+	else
+	{
+		vertex -= sphere_vertices;
+		object = vertex / 3 + spheres.length() + 1;
+		gl_Position = triangle_vertex(vertex / 3, vertex % 3);
+	}
+}
@@ -0,0 +1,77 @@
+// Queues shared by the wavefront kernels and WavefrontPresent.frag, included after RaytraceCommon.glsl.
+// Every kernel consumes one queue and appends to the next through atomic counters;
+// WavefrontState doubles as the indirect dispatch buffer.
+
+#define WAVEFRONT_GROUP_SIZE 64
+
+const uint NO_HIT = 0xFFFFFFFFu;
+// colors are accumulated as 16.16 fixed point, so the order in which rays finish does not matter
+const float ACCUM_SCALE = 65536.0f;
+
+struct QueuedRay
+{
+	vec3 origin;
+	uint pixel;
+	vec3 direction;
+	int depth; // -1 marks padding slots of the primary queue
+	vec3 color_mult;
+	uint transmitted;
+	vec3 hit_bary; // closest hit, written by the extend kernel
+	uint hit_object; // NO_HIT if the ray missed
+	vec3 hit_position;
+	uint hit_backface;
+};
+
+struct ShadowRay
+{
+	vec3 origin;
+	uint pixel;
+	vec3 direction;
+	vec3 lit; // contribution if the light is visible, scaled by the shadow ray's color_mult
+	vec3 unlit; // contribution if it is blocked
+};
+
+layout(std430, binding = 4) buffer RayQueueIn
+{
+	QueuedRay rays_in[];
+};
+
+layout(std430, binding = 5) buffer RayQueueOut
+{
+	QueuedRay rays_out[];
+};
+
+layout(std430, binding = 6) buffer ShadowQueue
+{
+	ShadowRay shadow_rays[];
+};
+
+layout(std430, binding = 7) buffer WavefrontState
+{
+	uvec4 ray_dispatch; // xyz: work groups of the extend and shade kernels, w: rays in rays_in
+	uvec4 shadow_dispatch; // xyz: work groups of the shadow kernel, w: rays in shadow_rays
+	uint next_ray_count;
+	uint ray_capacity;
+	uint shadow_capacity;
+	uint dropped_rays;
+	uint accum[]; // RGB per pixel
+};
+
+void accumulate(const in uint pixel, const in vec3 color)
+{
+	uvec3 value = uvec3(max(color, 0.0f) * ACCUM_SCALE + 0.5f);
+	if (value.r != 0u) atomicAdd(accum[3u * pixel], value.r);
+	if (value.g != 0u) atomicAdd(accum[3u * pixel + 1u], value.g);
+	if (value.b != 0u) atomicAdd(accum[3u * pixel + 2u], value.b);
+}
+
+Ray queued_ray(const in QueuedRay queued)
+{
+	Ray ray;
+	ray.origin = queued.origin;
+	ray.direction = queued.direction;
+	ray.color_mult = queued.color_mult;
+	ray.depth = queued.depth;
+	ray.transmitted = queued.transmitted != 0u;
+	return ray;
+}
@@ -0,0 +1,16 @@
+#version 430
+
+#include "RaytraceCommon.glsl"
+#include "Wavefront.glsl"
+
+layout(location = 0) out vec4 fragColor;
+
+uniform vec2 image_size;
+
+void main()
+{
+	uvec2 pixel = uvec2(gl_FragCoord.xy);
+	uint index = pixel.y * uint(image_size.x) + pixel.x;
+
+	fragColor = vec4(vec3(accum[3u * index], accum[3u * index + 1u], accum[3u * index + 2u]) / ACCUM_SCALE, 1.0f);
+}
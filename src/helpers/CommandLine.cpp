@@ -0,0 +1,182 @@
+#include "CommandLine.h"
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+static void print_usage(const char* program)
+{
+	std::cout << "Usage: " << program << " [--wavefront] [--aa-samples <n>] [--timings <path>] [--no-shader-cache] [--stochastic-paths] [--hybrid] [--history <n>] [--target-ms <ms>] [--downscale <n>] [--secondary-downscale <n>] [--roulette <depth>] [--mip-filter <filter>] | --headless [options]\n"
+		<< "  --wavefront             start the window with the compute wavefront tracer (toggle with P)\n"
+		<< "  --aa-samples <n>        extra samples per edge pixel of the fragment tracer, 0 = shade every\n"
+		<< "                          multisample instead (default 4, change with [ and ])\n"
+		<< "  --timings <path>        also write the per-pass GPU timings to a CSV file\n"
+		<< "  --no-shader-cache       compile every shader instead of loading cached program binaries\n"
+		<< "  --stochastic-paths      trace one randomly chosen path per sample instead of the whole ray\n"
+		<< "                          tree, converging over accumulated frames (toggle with T)\n"
+		<< "  --hybrid                rasterize the primary hits into a visibility buffer and trace only\n"
+		<< "                          the secondary rays (toggle with H)\n"
+		<< "  --history <n>           reuse reflections and refractions of the last frames by reprojection,\n"
+		<< "                          tracing them once every n frames per pixel, 1 = every frame\n"
+		<< "                          (default 1, change with - and =)\n"
+		<< "  --target-ms <ms>        keep the GPU time of the tracer near a target by lowering the\n"
+		<< "                          render resolution, recursion depth and edge samples\n"
+		<< "  --downscale <n>         trace at 1/n of the window size, 1, 2 or 4, and upscale guided by\n"
+		<< "                          the full-size geometry (default 1, change with U)\n"
+		<< "  --secondary-downscale <n> trace reflections and refractions at 1/n of the render size, 1, 2\n"
+		<< "                          or 4, and upsample them by depth and normal (default 1, change with K)\n"
+		<< "  --roulette <depth>      end reflection and refraction rays from this bounce on by Russian\n"
+		<< "                          roulette on their throughput, also headless (default 0 = off)\n"
+		<< "  --mip-filter <filter>   filter of the texture mip chains: kaiser (default) or box\n"
+		<< "Headless options:\n"
+		<< "  --model <path>          OBJ model relative to the project root\n"
+		<< "  --seed <n>              scene generation seed\n"
+		<< "  --width <n>             image width in pixels\n"
+		<< "  --height <n>            image height in pixels\n"
+		<< "  --samples <n>           samples per pixel\n"
+		<< "  --frames <n>            number of frames in the sequence\n"
+		<< "  --threads <n>           worker threads (0 = all cores)\n"
+		<< "  --traversal <mode>      primary ray traversal: packet (default) or ray\n"
+		<< "  --shadow-packets <on|off> batch shadow rays towards directional lights\n"
+		<< "  --output <path>         .png or .pfm output file\n"
+		<< "  --stream-rows <n>       write the image in bands of n tile rows as they finish,\n"
+		<< "                          keeping only one band in memory (0 = whole frame)\n"
+		<< "  --cam <x,y,z>           camera position\n"
+		<< "  --cam-to <x,y,z>        camera position at the last frame\n"
+		<< "  --rot <yaw,pitch>       camera rotation in degrees\n"
+		<< "  --rot-to <yaw,pitch>    camera rotation at the last frame\n";
+}
+
+static bool parse_floats(const std::string& text, float* values, int count)
+{
+	std::stringstream stream(text);
+	std::string component;
+	for (int i = 0; i < count; i++)
+	{
+		if (!std::getline(stream, component, ',')) return false;
+		try { values[i] = std::stof(component); }
+		catch (...) { return false; }
+	}
+	return stream.eof();
+}
+
+static bool parse_int(const std::string& text, int& value)
+{
+	try
+	{
+		size_t end;
+		value = std::stoi(text, &end);
+		return end == text.size();
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+bool parse_command_line(int argc, char** argv, HeadlessOptions& options)
+{
+	bool has_position_end = false;
+	bool has_rot_end = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+
+		if (arg == "--headless")
+		{
+			options.enabled = true;
+			continue;
+		}
+		if (arg == "--wavefront")
+		{
+			options.wavefront = true;
+			continue;
+		}
+		if (arg == "--stochastic-paths")
+		{
+			options.stochastic_paths = true;
+			continue;
+		}
+		if (arg == "--hybrid")
+		{
+			options.hybrid = true;
+			continue;
+		}
+		if (arg == "--no-shader-cache")
+		{
+			options.shader_cache = false;
+			continue;
+		}
+		if (arg == "--help" || arg == "-h")
+		{
+			print_usage(argv[0]);
+			return false;
+		}
+		if (i + 1 >= argc)
+		{
+			std::cout << "Missing value for " << arg << std::endl;
+			print_usage(argv[0]);
+			return false;
+		}
+
+		std::string value = argv[++i];
+		int seed = 0;
+		bool valid = true;
+
+		if (arg == "--model") options.model = value;
+		else if (arg == "--output") options.output = value;
+		else if (arg == "--seed") { valid = parse_int(value, seed) && seed >= 0; options.seed = seed; }
+		else if (arg == "--width") valid = parse_int(value, options.width) && options.width > 0;
+		else if (arg == "--height") valid = parse_int(value, options.height) && options.height > 0;
+		else if (arg == "--samples") valid = parse_int(value, options.samples) && options.samples > 0;
+		else if (arg == "--frames") valid = parse_int(value, options.frames) && options.frames > 0;
+		else if (arg == "--threads") valid = parse_int(value, options.threads) && options.threads >= 0;
+		else if (arg == "--traversal") { valid = value == "packet" || value == "ray"; options.packet_traversal = value == "packet"; }
+		else if (arg == "--shadow-packets") { valid = value == "on" || value == "off"; options.shadow_packets = value == "on"; }
+		else if (arg == "--timings") options.timings_csv = value;
+		else if (arg == "--aa-samples") valid = parse_int(value, options.aa_samples) && options.aa_samples >= 0 && options.aa_samples <= 16;
+		else if (arg == "--history") valid = parse_int(value, options.history_length) && options.history_length >= 1 && options.history_length <= 16;
+		else if (arg == "--target-ms") valid = parse_floats(value, &options.target_ms, 1) && options.target_ms > 0.0f;
+		else if (arg == "--downscale") valid = parse_int(value, options.downscale) && (options.downscale == 1 || options.downscale == 2 || options.downscale == 4);
+		else if (arg == "--secondary-downscale") valid = parse_int(value, options.secondary_downscale) && (options.secondary_downscale == 1 || options.secondary_downscale == 2 || options.secondary_downscale == 4);
+		else if (arg == "--roulette") valid = parse_int(value, options.roulette_depth) && options.roulette_depth >= 0;
+		else if (arg == "--mip-filter") { valid = value == "kaiser" || value == "box"; options.kaiser_mips = value == "kaiser"; }
+		else if (arg == "--stream-rows") valid = parse_int(value, options.stream_rows) && options.stream_rows >= 0;
+		else if (arg == "--cam") valid = parse_floats(value, &options.cam_position.x, 3);
+		else if (arg == "--cam-to") valid = has_position_end = parse_floats(value, &options.cam_position_end.x, 3);
+		else if (arg == "--rot") valid = parse_floats(value, &options.cam_rot.x, 2);
+		else if (arg == "--rot-to") valid = has_rot_end = parse_floats(value, &options.cam_rot_end.x, 2);
+		else
+		{
+			std::cout << "Unknown option " << arg << std::endl;
+			print_usage(argv[0]);
+			return false;
+		}
+
+		if (!valid)
+		{
+			std::cout << "Invalid value for " << arg << ": " << value << std::endl;
+			print_usage(argv[0]);
+			return false;
+		}
+	}
+
+	if (!has_position_end) options.cam_position_end = options.cam_position;
+	if (!has_rot_end) options.cam_rot_end = options.cam_rot;
+
+	return true;
+}
+
+std::string frame_output_path(const HeadlessOptions& options, int frame)
+{
+	if (options.frames <= 1) return options.output;
+
+	char suffix[16];
+	snprintf(suffix, sizeof(suffix), "_%04d", frame);
+
+	auto dot = options.output.find_last_of('.');
+	auto slash = options.output.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return options.output + suffix;
+	return options.output.substr(0, dot) + suffix + options.output.substr(dot);
+}
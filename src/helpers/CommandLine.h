@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <glm/glm.hpp>
+
+struct HeadlessOptions
+{
+	bool enabled;
+	std::string model;
+	unsigned seed;
+	int width;
+	int height;
+	int samples;
+	int frames;
+	int threads;
+	bool packet_traversal;
+	bool shadow_packets;
+	int stream_rows;
+	std::string output;
+	glm::vec3 cam_position;
+	glm::vec3 cam_position_end;
+	glm::vec2 cam_rot;
+	glm::vec2 cam_rot_end;
+	// window mode: start with the compute wavefront pipeline instead of Raytrace.frag
+	bool wavefront;
+	// window mode: extra samples traced on edge pixels, 0 shades every sample of the multisampled framebuffer
+	int aa_samples;
+	// window mode: CSV file for the GPU timings of every report, empty for none
+	std::string timings_csv;
+	// window mode: load and store linked programs in the shader_cache directory
+	bool shader_cache;
+	// window mode: Raytrace.frag follows one stochastic path per sample instead of the whole ray tree
+	bool stochastic_paths;
+	// window mode: primary hits of the fragment tracer come from a rasterized visibility buffer
+	bool hybrid;
+	// window mode: frames the fragment tracer reuses reprojected secondary rays for, 1 traces them every frame
+	int history_length;
+	// window mode: GPU time per frame the tracer is kept near by lowering its quality, 0 for no limit
+	float target_ms;
+	// window mode: trace at 1 / downscale of the window size and upscale guided by the full-size geometry
+	int downscale;
+	// window mode: trace the reflection and refraction rays at 1 / secondary_downscale of the render size
+	int secondary_downscale;
+	// bounce from which reflection and refraction rays are terminated by Russian roulette, 0 for none
+	int roulette_depth;
+	// window mode: filter of the scene textures' mip chains, Kaiser-windowed sinc or else box
+	bool kaiser_mips;
+
+	HeadlessOptions() : enabled(false), model("res/models/growth chamber.obj"), seed(0), width(1024), height(768), samples(1), frames(1), threads(0), packet_traversal(true), shadow_packets(true), stream_rows(0),
+						output("render.png"), cam_position(0.0f), cam_position_end(0.0f), cam_rot(0.0f), cam_rot_end(0.0f), wavefront(false), aa_samples(4), timings_csv(), shader_cache(true), stochastic_paths(false), hybrid(false), history_length(1), target_ms(0.0f), downscale(1), secondary_downscale(1), roulette_depth(0), kaiser_mips(true) {}
+};
+
+// Parses the command line into options; returns false (after printing usage) on invalid input.
+bool parse_command_line(int argc, char** argv, HeadlessOptions& options);
+
+// Output path of the given frame: the plain path for single frames, otherwise with a _NNNN suffix before the extension.
+std::string frame_output_path(const HeadlessOptions& options, int frame);
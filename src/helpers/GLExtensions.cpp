@@ -0,0 +1,15 @@
+#include "GLExtensions.h"
+
+#include <cstring>
+#include <glad/glad.h>
+
+bool gl_extension_supported(const char* name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++)
+	{
+		if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0) return true;
+	}
+	return false;
+}
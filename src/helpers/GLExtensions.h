@@ -0,0 +1,4 @@
+#pragma once
+
+// Whether the current context advertises the named extension; needs a current context and loaded GL.
+bool gl_extension_supported(const char* name);
@@ -2,6 +2,17 @@
 #include <iostream>
 #include <vector>
 #include <random>
+#include <chrono>
+#include <thread>
+#ifdef _WIN32
+#define  NOMINMAX
+#define  WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
@@ -10,23 +21,55 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "rendering/Shader.h"
-#include "rendering/Texture.h"
+#include "rendering/ShaderVariants.h"
+#include "rendering/TextureSet.h"
 #include "rendering/Lights.h"
 #include "rendering/SceneObjects.h"
 #include "rendering/Model.h"
+#include "rendering/Image.h"
+#include "rendering/CpuRenderer.h"
+#include "rendering/WavefrontTracer.h"
+#include "rendering/Accumulator.h"
+#include "rendering/AdaptiveSampler.h"
+#include "rendering/SceneBuffers.h"
+#include "rendering/GpuTimer.h"
+#include "rendering/FrameUniforms.h"
+#include "rendering/VisibilityBuffer.h"
+#include "rendering/TemporalCache.h"
+#include "rendering/FrameGovernor.h"
+#include "rendering/BilateralUpscaler.h"
+#include "rendering/SecondaryUpsampler.h"
+#include "helpers/CommandLine.h"
 
 GLFWwindow* window;
 int window_width  = 1024;
 int window_height = 768;
+// the fragment and wavefront tracers render at a fraction of the window size when the governor lowers it,
+// further divided by the user's downscale of 1, 2 or 4
+float render_scale = 1.0f;
+int downscale = 1;
+int render_width  = 1024;
+int render_height = 768;
 
 const int NUM_LIGHTS = 10;
 const int NUM_SPHERES = 10;
-const int NUM_TEXTURES = 20;
 
 const float PITCH_LIMIT = M_PI_2 - 1e-3f;
 const float MOUSE_SENS = 0.5f;
 const float MOVE_SPEED = 3.0f;
 
+static const char* texture_files[] = {
+    "res/textures/checker.png",
+    "res/textures/normalnoise.png",
+    "res/models/growth chamber.png"
+};
+// normalnoise.png perturbs the normals of the spheres, its mip levels are renormalized
+static const MipChain::Content texture_contents[] = {
+    MipChain::Content::Color,
+    MipChain::Content::NormalMap,
+    MipChain::Content::Color
+};
+
 static const GLfloat screen_triangles[] = {
     -1.0f, -1.0f, 0.0f,
     1.0f, -1.0f, 0.0f,
@@ -37,13 +80,47 @@ static const GLfloat screen_triangles[] = {
 };
 
 
+ShaderVariants * tracer_variants = nullptr;
+// the variant of tracer_variants for the current scene
 Shader  * shader  = nullptr;
-Texture * texture = nullptr;
-Texture * nmap = nullptr;
-Texture * modelTex = nullptr;
+Shader::Uniform<int> tracer_sampling;
+FrameUniforms * frame_uniforms = nullptr;
+TextureSet * scene_textures = nullptr;
+MipChain::Filter mip_filter = MipChain::Filter::Kaiser;
 
 Model * model = nullptr;
 
+WavefrontTracer * wavefront = nullptr;
+bool use_wavefront = false;
+
+Accumulator * accumulator = nullptr;
+bool use_accumulation = true;
+// one stochastic path per sample in Raytrace.frag instead of the whole ray tree
+bool stochastic_paths = false;
+// primary hits of Raytrace.frag rasterized into a visibility buffer
+VisibilityBuffer * visibility = nullptr;
+bool use_visibility = false;
+// frames a traced secondary result of Raytrace.frag is reprojected for, 1 traces the secondary rays every frame
+TemporalCache * temporal_cache = nullptr;
+int history_length = 1;
+// reflection and refraction rays of Raytrace.frag traced at 1 / secondary_downscale of the render size, 1 for all
+SecondaryUpsampler * secondary_upsampler = nullptr;
+int secondary_downscale = 1;
+
+// extra samples on edge pixels, 0 shades every sample of the multisampled framebuffer instead; the user's choice,
+// which the governor's level can only lower
+AdaptiveSampler * edge_sampler = nullptr;
+int aa_samples = 4;
+
+// bounces of the fragment tracer, lowered along with the render scale to keep a frame time target
+unsigned recursion_depth = 5;
+// rays spawned at this depth or deeper survive with a probability of their throughput, 0 keeps every ray
+int roulette_depth = 0;
+FrameGovernor * governor = nullptr;
+// a reduced render size is scaled up guided by the geometry of the window size, or else bilinearly
+BilateralUpscaler * upscaler = nullptr;
+bool bilateral_upscale = true;
+
 glm::vec3 cam_position = glm::vec3(0.0f, 0.0f, 0.0f);
 glm::vec3 cam_up = glm::vec3(0.0f, 1.0f, 0.0f);
 glm::vec3 cam_u  = glm::vec3(1.0f, 0.0f, 0.0f);
@@ -64,14 +141,16 @@ glm::vec3 img_up;
 GLuint vaoID;
 GLuint vboID;
 
-glm::vec4 ground_plane;
+glm::vec4 ground_plane = glm::vec4(0.0f, 1.0f, 0.0f, -1.0f);
 
 std::vector<Light> lights;
 std::vector<Sphere> spheres;
 std::vector<Vertex> vertices;
 std::vector<Triangle> triangles;
 
-GLuint buffers[4];
+SceneBuffers * scene_buffers = nullptr;
+GpuTimer * gpu_timer = nullptr;
+std::string timings_csv;
 
 unsigned gen_seed = 0;
 
@@ -89,7 +168,7 @@ void update_camera_direction()
     cam_v = glm::normalize(glm::cross(cam_w, cam_u));
 }
 
-void update_camera()
+void update_image_plane()
 {
     float aspect = (float)window_width / (float)window_height;
     view_l = aspect * view_b;
@@ -98,31 +177,126 @@ void update_camera()
     img_origin = cam_position - (view_d * cam_w) + (view_l * cam_u) + (view_b * cam_v);
     img_right = (view_r - view_l) * cam_u;
     img_up = (view_t - view_b) * cam_v;
+}
+
+void update_camera()
+{
+    update_image_plane();
+
+    render_width = std::max(1, (int)(window_width * render_scale / downscale + 0.5f));
+    render_height = std::max(1, (int)(window_height * render_scale / downscale + 0.5f));
 
-    shader->setUniform3fv("cam_pos", cam_position);
-    shader->setUniform3fv("img_origin", img_origin);
-    shader->setUniform3fv("img_right", img_right);
-    shader->setUniform3fv("img_up", img_up);
-    shader->setUniform2fv("pixel_size", glm::vec2(1.0f / window_width, 1.0f / window_height));
+    frame_uniforms->setCamera(cam_position, img_origin, img_right, img_up);
+    frame_uniforms->setPixelSize(glm::vec2(1.0f / render_width, 1.0f / render_height));
 }
 
-void update_scene()
+void select_pipeline(bool wavefront_pipeline)
+{
+    use_wavefront = wavefront_pipeline;
+
+    if (use_wavefront && !wavefront)
+    {
+        wavefront = new WavefrontTracer(*scene_textures);
+        wavefront->setGroundPlane(ground_plane);
+        wavefront->setRouletteDepth(roulette_depth);
+    }
+
+    if (accumulator) accumulator->reset();
+
+    std::cout << "Pipeline: " << (use_wavefront ? "wavefront compute" : "fragment") << std::endl;
+}
+
+// Switches off the Raytrace.frag features no object of the scene uses. Textures cannot make a material
+// transmissive or reflective: they are stored without alpha and only scale the material's colors.
+ShaderDefines scene_defines()
 {
-    GLsizeiptr size = lights.size() * sizeof(Light);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffers[0]);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, size, lights.data(), GL_STATIC_DRAW);
+    bool transmission = false;
+    bool reflection = false;
+    bool normal_maps = false;
+    auto inspect = [&](const Material& material)
+    {
+        transmission = transmission || material.diffuse.a < 0.99f;
+        reflection = reflection || material.reflective.r + material.reflective.g + material.reflective.b > 0.01f;
+        normal_maps = normal_maps || material.normalmap >= 0;
+    };
+    for (const Sphere& sphere : spheres) inspect(sphere.material);
+    for (const Vertex& vertex : vertices) inspect(vertex.material);
+
+    // every ray spawns a transmitted and a reflected ray, or only the reflected one, or none;
+    // a stochastic path has no ray stack
+    unsigned max_rays = transmission ? (1u << recursion_depth) - 1 : reflection ? recursion_depth : 1;
+    if (stochastic_paths) max_rays = 1;
+
+    ShaderDefines defines;
+    defines["SCENE_SPHERES"] = spheres.empty() ? "0" : "1";
+    defines["SCENE_TRANSMISSION"] = transmission ? "1" : "0";
+    defines["SCENE_NORMAL_MAPS"] = normal_maps ? "1" : "0";
+    defines["RECURSION_DEPTH"] = std::to_string(recursion_depth) + "u";
+    defines["MAX_RAYS"] = std::to_string(max_rays) + "u";
+    defines["STOCHASTIC_PATHS"] = stochastic_paths ? "1" : "0";
+    defines["VISIBILITY_BUFFER"] = use_visibility ? "1" : "0";
+    defines["TEMPORAL_CACHE"] = history_length > 1 ? "1" : "0";
+    defines["LOW_RES_SECONDARY"] = secondary_downscale > 1 ? "1" : "0";
+    return defines;
+}
 
-    size = spheres.size() * sizeof(Sphere);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, buffers[1]);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, size, spheres.data(), GL_STATIC_DRAW);
+void select_tracer()
+{
+    Shader* variant = tracer_variants->get(scene_defines());
+    if (variant == shader) return;
+
+    // uniforms are per program, so a variant gets everything that is not set every frame
+    shader = variant;
+    scene_textures->setUniforms(*shader);
+    edge_sampler->setUniforms(*shader);
+    if (use_visibility) visibility->setUniforms(*shader);
+    if (history_length > 1) temporal_cache->setUniforms(*shader);
+    if (secondary_downscale > 1) secondary_upsampler->setUniforms(*shader);
+    temporal_cache->reset();
+    shader->setUniform4fv("ground_plane", ground_plane);
+    // a single bounce spawns no rays, the uniform is compiled out then
+    if (recursion_depth > 1) shader->setUniform1i("roulette_depth", roulette_depth);
+    tracer_sampling = shader->getUniform<int>("sampling");
+}
 
-    size = vertices.size() * sizeof(Vertex);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, buffers[2]);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, size, vertices.data(), GL_STATIC_DRAW);
+// the user's edge samples, capped by the governor's level; shading every multisample stays a choice of the user
+void apply_sample_budget()
+{
+    if (aa_samples == 0) return;
+    edge_sampler->setSampleBudget(governor ? std::min(aa_samples, governor->getLevel().aa_samples) : aa_samples);
+}
 
-    size = triangles.size() * sizeof(Triangle);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, buffers[3]);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, size, triangles.data(), GL_STATIC_DRAW);
+// takes over the render scale, recursion depth and edge samples of the governor's level
+void apply_governor_level()
+{
+    const FrameGovernor::Level& level = governor->getLevel();
+    render_scale = level.render_scale;
+    recursion_depth = level.recursion_depth;
+    apply_sample_budget();
+    select_tracer();
+    accumulator->reset();
+}
+
+void update_scene()
+{
+    scene_buffers->assign(SceneBuffers::LIGHTS, lights);
+    scene_buffers->assign(SceneBuffers::SPHERES, spheres);
+    scene_buffers->assign(SceneBuffers::VERTICES, vertices);
+    scene_buffers->assign(SceneBuffers::TRIANGLES, triangles);
+
+    select_tracer();
+}
+
+// turns the directional lights around the vertical axis; only the light buffer is written
+void rotate_lights(float angle)
+{
+    glm::mat3 rotation = glm::mat3(glm::rotate(glm::mat4(1.0f), angle, glm::vec3(0.0f, 1.0f, 0.0f)));
+    for (size_t i = 0; i < lights.size(); i++)
+    {
+        if (lights[i].type != 1) continue;
+        lights[i].direction = rotation * lights[i].direction;
+        scene_buffers->update(SceneBuffers::LIGHTS, lights, i, 1);
+    }
 }
 
 void make_triangle(unsigned vi1, unsigned vi2, unsigned vi3, const glm::vec3& normal)
@@ -140,9 +314,7 @@ void make_triangle(unsigned vi1, unsigned vi2, unsigned vi3, const glm::vec3& no
         float det = b.x * c.y - c.x * b.y;
         uvtrans = glm::mat2(c.y / det, -b.y / det, -c.x / det, b.x / det);
     }
-    glm::vec3 center = (v1.position + v2.position + v3.position) / 3.0f;
-    float radius = std::max(glm::length(v1.position - center), std::max(glm::length(v2.position - center), glm::length(v3.position - center)));
-    triangles.push_back(Triangle(glm::uvec3(vi1, vi2, vi3), normal, uvtrans, glm::vec4(center, radius)));
+    triangles.push_back(Triangle(glm::uvec3(vi1, vi2, vi3), normal, uvtrans, v1.position, v2.position, v3.position));
 }
 
 void make_triangle(unsigned vi1, unsigned vi2, unsigned vi3)
@@ -229,8 +401,78 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         gen_seed++;
         generate_scene();
         update_scene();
+        accumulator->reset();
+        temporal_cache->reset();
         std::cout << gen_seed << std::endl;
     }
+    else if (key == GLFW_KEY_L)
+    {
+        rotate_lights(glm::radians(15.0f));
+        accumulator->reset();
+        temporal_cache->reset();
+    }
+    else if (key == GLFW_KEY_P)
+    {
+        select_pipeline(!use_wavefront);
+    }
+    else if (key == GLFW_KEY_LEFT_BRACKET || key == GLFW_KEY_RIGHT_BRACKET)
+    {
+        aa_samples = std::max(0, std::min(aa_samples + (key == GLFW_KEY_RIGHT_BRACKET ? 1 : -1), AdaptiveSampler::MAX_SAMPLES));
+        apply_sample_budget();
+        accumulator->reset();
+        if (aa_samples > 0) std::cout << "Adaptive anti-aliasing: " << aa_samples << " extra samples per edge pixel" << std::endl;
+        else std::cout << "Multisample anti-aliasing: every sample shaded" << std::endl;
+    }
+    else if (key == GLFW_KEY_C)
+    {
+        use_accumulation = !use_accumulation;
+        accumulator->reset();
+        std::cout << "Progressive accumulation " << (use_accumulation ? "on" : "off") << std::endl;
+    }
+    else if (key == GLFW_KEY_T)
+    {
+        stochastic_paths = !stochastic_paths;
+        select_tracer();
+        accumulator->reset();
+        std::cout << "Fragment tracer: " << (stochastic_paths ? "one stochastic path per sample" : "whole ray tree") << std::endl;
+    }
+    else if (key == GLFW_KEY_H)
+    {
+        use_visibility = !use_visibility;
+        select_tracer();
+        accumulator->reset();
+        std::cout << "Primary hits: " << (use_visibility ? "rasterized visibility buffer" : "traced") << std::endl;
+    }
+    else if (key == GLFW_KEY_MINUS || key == GLFW_KEY_EQUAL)
+    {
+        history_length = std::max(1, std::min(history_length + (key == GLFW_KEY_EQUAL ? 1 : -1), TemporalCache::MAX_HISTORY));
+        if (history_length > 1) temporal_cache->setHistoryLength(history_length);
+        select_tracer();
+        accumulator->reset();
+        if (history_length > 1) std::cout << "Temporal reprojection: secondary rays traced every " << history_length << " frames" << std::endl;
+        else std::cout << "Temporal reprojection off" << std::endl;
+    }
+    else if (key == GLFW_KEY_K)
+    {
+        secondary_downscale = secondary_downscale == 4 ? 1 : 2 * secondary_downscale;
+        select_tracer();
+        accumulator->reset();
+        if (secondary_downscale > 1) std::cout << "Reflections and refractions: 1/" << secondary_downscale << " of the render size" << std::endl;
+        else std::cout << "Reflections and refractions: every sample" << std::endl;
+    }
+    else if (key == GLFW_KEY_U)
+    {
+        downscale = downscale == 4 ? 1 : 2 * downscale;
+        accumulator->reset();
+        std::cout << "Render size: 1/" << downscale << " of the window" << std::endl;
+    }
+    else if (key == GLFW_KEY_B)
+    {
+        bilateral_upscale = !bilateral_upscale;
+        // the guides were not kept up to date while bilinear upscaling
+        upscaler->reset();
+        std::cout << "Upscaling: " << (bilateral_upscale ? "joint bilateral" : "bilinear") << std::endl;
+    }
     else if (key == GLFW_KEY_F4 && mods == GLFW_MOD_ALT)
     {
         glfwSetWindowShouldClose(window, GLFW_TRUE);
@@ -242,6 +484,7 @@ void window_size_callback(GLFWwindow* window, int width, int height)
     glViewport(0, 0, width, height);
     window_width = width;
     window_height = height;
+    if (accumulator) accumulator->reset();
 }
 
 int init()
@@ -280,6 +523,8 @@ int init()
         return -1;
     }
 
+    Shader::enableParallelCompile((GLADloadproc)glfwGetProcAddress);
+
     /* Set the viewport */
     glClearColor(0.6784f, 0.8f, 1.0f, 1.0f);
     glViewport(0, 0, window_width, window_height);
@@ -292,29 +537,29 @@ int init()
 
 int loadContent()
 {
-    /* Create and apply basic shader */
-    shader = new Shader("Basic.vert", "Raytrace.frag");
-    GLuint program = shader->get_program_id();
-    shader->apply();
+    /* The tracer is compiled for the scene once it is generated */
+    tracer_variants = new ShaderVariants("Basic.vert", "Raytrace.frag");
 
-    for (int i = 0; i < NUM_TEXTURES; i++)
+    scene_textures = new TextureSet((GLADloadproc)glfwGetProcAddress);
+    scene_textures->setMipFilter(mip_filter);
+    for (size_t i = 0; i < sizeof(texture_files) / sizeof(texture_files[0]); i++)
     {
-        shader->setUniform1i("textures[" + std::to_string(i) + "]", i);
+        scene_textures->add(texture_files[i], texture_contents[i]);
     }
+    if (!scene_textures->upload())
+        return false;
+    std::cout << scene_textures->getCount() << " textures in " << (scene_textures->isBindless() ? "bindless handles" : "texture arrays") << std::endl;
+
+    gpu_timer = new GpuTimer();
+    if (!timings_csv.empty() && !gpu_timer->openCsv(timings_csv))
+        return false;
 
-    glGenBuffers(4, buffers);
+    frame_uniforms = new FrameUniforms();
+    scene_buffers = new SceneBuffers();
+    if (!scene_buffers->isPersistent()) std::cout << "GL 4.4 not available, scene buffers are updated with glBufferSubData" << std::endl;
 
     model = new Model("res/models/growth chamber.obj");
     
-    update_camera_direction();
-    update_camera();
-
-    ground_plane = glm::vec4(0.0f, 1.0f, 0.0f, -1.0f);
-    shader->setUniform4fv("ground_plane", ground_plane);
-
-    generate_scene();
-    update_scene();
-
     glGenVertexArrays(1, &vaoID);
     glBindVertexArray(vaoID);
 
@@ -322,15 +567,21 @@ int loadContent()
     glBindBuffer(GL_ARRAY_BUFFER, vboID);
     glBufferData(GL_ARRAY_BUFFER, sizeof(screen_triangles), screen_triangles, GL_STATIC_DRAW);
 
-    texture = new Texture();
-    texture->load("res/textures/checker.png");
-    texture->bind(0);
-    nmap = new Texture();
-    nmap->load("res/textures/normalnoise.png");
-    nmap->bind(1);
-    modelTex = new Texture();
-    modelTex->load("res/models/growth chamber.png");
-    modelTex->bind(2);
+    accumulator = new Accumulator();
+    edge_sampler = new AdaptiveSampler();
+    visibility = new VisibilityBuffer();
+    temporal_cache = new TemporalCache();
+    upscaler = new BilateralUpscaler();
+    secondary_upsampler = new SecondaryUpsampler();
+    upscaler->setGroundPlane(ground_plane);
+    if (history_length > 1) temporal_cache->setHistoryLength(history_length);
+    apply_sample_budget();
+
+    update_camera_direction();
+    generate_scene();
+    update_scene();
+
+    select_pipeline(use_wavefront);
 
     /*glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);*/
@@ -338,6 +589,15 @@ int loadContent()
     return true;
 }
 
+void draw_screen()
+{
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, vboID);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glDisableVertexAttribArray(0);
+}
+
 void render(float time, float deltaTime)
 {
     static float accumulatedDelta = 0.0f;
@@ -346,11 +606,29 @@ void render(float time, float deltaTime)
     accumulatedDelta += deltaTime;
     accumulatedFrames++;
     if (accumulatedDelta > .5f) {
-        std::cout << "Avg FPS: " << accumulatedFrames / accumulatedDelta << std::endl;
+        std::cout << "Avg FPS: " << accumulatedFrames / accumulatedDelta;
+        if (use_accumulation) std::cout << ", " << accumulator->getFrameCount() << " frames accumulated";
+        if (aa_samples > 0 && !use_wavefront) std::cout << ", " << 100.0 * edge_sampler->getEdgePixels() / ((double)render_width * render_height) << "% edge pixels";
+        std::cout << std::endl;
+        gpu_timer->report(std::cout, time);
+        if (governor) governor->report(std::cout);
+        if (use_wavefront)
+        {
+            unsigned dropped = wavefront->getDroppedRays();
+            if (dropped > 0) std::cout << "Wavefront queues full, " << dropped << " rays dropped" << std::endl;
+        }
         accumulatedDelta = 0.0f;
         accumulatedFrames = 0;
     }
 
+    // edited shaders are swapped in once they link, until then the current ones keep rendering
+    if (tracer_variants->update())
+    {
+        shader = nullptr;
+        select_tracer();
+        accumulator->reset();
+    }
+
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     double cursorX, cursorY;
@@ -408,15 +686,116 @@ void render(float time, float deltaTime)
 
     update_camera();
 
-    texture->bind(0);
-    nmap->bind(1);
-    modelTex->bind(2);
+    static glm::vec3 last_cam_position = cam_position;
+    static glm::vec2 last_cam_rot = cam_rot;
+    if (cam_position != last_cam_position || cam_rot != last_cam_rot)
+    {
+        accumulator->reset();
+        last_cam_position = cam_position;
+        last_cam_rot = cam_rot;
+    }
 
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, vboID);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glDisableVertexAttribArray(0);
+    gpu_timer->beginFrame();
+
+    glm::vec2 jitter = use_accumulation ? accumulator->getJitter() : glm::vec2(0.0f);
+    frame_uniforms->setJitter(jitter);
+
+    gpu_timer->begin("upload");
+    frame_uniforms->upload();
+    scene_buffers->flush();
+    gpu_timer->end();
+
+    // a reduced render size is traced into the accumulator like accumulation is, which scales it up when presenting
+    bool offscreen = use_accumulation || render_width != window_width || render_height != window_height;
+    if (!use_accumulation) accumulator->reset();
+
+    // a converged image is only presented again until something changes
+    if (!use_accumulation || !accumulator->isConverged())
+    {
+        gpu_timer->begin("trace");
+        glViewport(0, 0, render_width, render_height);
+
+        // adaptive frames are anti-aliased on their own; when accumulating, only the first frame after a reset
+        // is one, the later ones take their anti-aliasing from the jitter
+        bool edge_aa = aa_samples > 0 && !use_wavefront && (!use_accumulation || accumulator->getFrameCount() == 0);
+
+        // the single-sample passes, edge base and jittered, take their primary hits from the visibility buffer;
+        // shading every multisample traces them all
+        if (use_visibility && !use_wavefront && (edge_aa || offscreen))
+        {
+            gpu_timer->begin("visibility");
+            visibility->render(render_width, render_height, (unsigned)spheres.size(), (unsigned)triangles.size());
+            gpu_timer->end();
+        }
+        if (history_length > 1 && !use_wavefront && (edge_aa || offscreen))
+        {
+            temporal_cache->bind(*shader, render_width, render_height);
+        }
+        if (secondary_downscale > 1 && !use_wavefront)
+        {
+            gpu_timer->begin("secondary");
+            secondary_upsampler->bind(*shader, render_width, render_height, secondary_downscale);
+            shader->apply();
+            draw_screen();
+            secondary_upsampler->bindResults();
+            gpu_timer->end();
+        }
+
+        if (edge_aa)
+        {
+            edge_sampler->bindBase(*shader, render_width, render_height);
+            shader->apply();
+            draw_screen();
+            edge_sampler->bindRefine(*shader);
+            draw_screen();
+            edge_sampler->present();
+        }
+
+        if (offscreen) accumulator->bind(render_width, render_height);
+        else glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        // for edge_aa the copy shader is applied already
+        if (use_wavefront)
+        {
+            wavefront->resize(render_width, render_height, (unsigned)lights.size());
+            wavefront->render();
+        }
+        else if (!edge_aa)
+        {
+            // the accumulator's target has a single sample per pixel
+            shader->set(tracer_sampling, offscreen ? SAMPLING_JITTER : SAMPLING_MULTISAMPLE);
+            shader->apply();
+        }
+
+        draw_screen();
+        gpu_timer->end();
+    }
+
+    if (offscreen)
+    {
+        gpu_timer->begin("present");
+        bool scaled = render_width != window_width || render_height != window_height;
+        if (scaled && bilateral_upscale)
+        {
+            // the first frame after an accumulator reset is the first of a new view
+            if (accumulator->getFrameCount() == 1) upscaler->reset();
+            upscaler->present(accumulator->getTexture(), render_width, render_height, window_width, window_height,
+                              (unsigned)spheres.size(), (unsigned)triangles.size());
+        }
+        else accumulator->present(window_width, window_height);
+        draw_screen();
+        gpu_timer->end();
+    }
+
+    gpu_timer->endFrame();
+    scene_buffers->fence();
+
+    double trace_ms;
+    if (governor && gpu_timer->takeLatest("trace", trace_ms) && governor->update(trace_ms))
+    {
+        apply_governor_level();
+        governor->report(std::cout);
+    }
 }
 
 void update()
@@ -447,22 +826,217 @@ void update()
     }
 }
 
-int main(void)
+// peak resident set size of the process in bytes
+uint64_t peak_memory_usage()
 {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss;
+#else
+    return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+// Renders the frame in bands of options.stream_rows tile rows and writes every band as soon as it is done,
+// in the row order of the output format, so only one band is ever held in memory.
+bool render_streamed(const CpuRenderer& renderer, const HeadlessOptions& options, int threads, const std::string& path, CpuRenderer::Stats& stats, uint64_t& bytes_written)
+{
+    ImageWriter::Format format;
+    if (!ImageWriter::formatFromFilename(path, format))
+    {
+        std::cout << "Unsupported image format: " << path << std::endl;
+        return false;
+    }
+
+    ImageWriter writer;
+    if (!writer.open(path, format, options.width, options.height))
+        return false;
+
+    int band_height = options.stream_rows * CpuRenderer::TILE_SIZE;
+    int band_count = (options.height + band_height - 1) / band_height;
+    Image band;
+
+    for (int i = 0; i < band_count; i++)
+    {
+        // bands start on multiples of band_height from the bottom; only the top one can be partial
+        int index = writer.topDown() ? band_count - 1 - i : i;
+        int first_row = index * band_height;
+        int rows = std::min(band_height, options.height - first_row);
+        if (band.height != rows) band = Image(options.width, rows);
+
+        stats += renderer.renderRows(band, first_row, options.height, options.samples, threads);
+        if (!writer.writeRows(band))
+            return false;
+    }
+
+    bytes_written = writer.getBytesWritten();
+    return writer.close();
+}
+
+int run_headless(const HeadlessOptions& options)
+{
+    using clock = std::chrono::steady_clock;
+    auto load_start = clock::now();
+
+    window_width = options.width;
+    window_height = options.height;
+    gen_seed = options.seed;
+
+    model = new Model(options.model);
+    generate_scene();
+
+    std::vector<Image> textures(sizeof(texture_files) / sizeof(texture_files[0]));
+    for (size_t i = 0; i < textures.size(); i++)
+    {
+        textures[i].load(texture_files[i]);
+    }
+
+    CpuRenderer renderer(lights, spheres, vertices, triangles, textures);
+    renderer.setGroundPlane(ground_plane);
+    renderer.setTraversal(options.packet_traversal ? CpuRenderer::Traversal::Packet : CpuRenderer::Traversal::Ray);
+    renderer.setShadowPackets(options.shadow_packets);
+    renderer.setRouletteDepth(options.roulette_depth);
+
+    int threads = options.threads > 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    double load_ms = std::chrono::duration<double, std::milli>(clock::now() - load_start).count();
+    std::cout << "Scene loaded in " << load_ms << " ms (" << triangles.size() << " triangles, " << spheres.size() << " spheres, " << lights.size() << " lights)" << std::endl;
+    std::cout << "Rendering " << options.frames << " frame(s) at " << options.width << "x" << options.height << ", " << options.samples << " spp, " << threads << " threads" << std::endl;
+
+    if (options.stream_rows > 0)
+    {
+        std::cout << "Streaming output in bands of " << options.stream_rows * CpuRenderer::TILE_SIZE << " rows" << std::endl;
+    }
+
+    Image frame;
+    if (options.stream_rows == 0) frame = Image(options.width, options.height);
+    double total_ms = 0.0, min_ms = 0.0, max_ms = 0.0;
+    uint64_t total_rays = 0;
+    CpuRenderer::Stats total_stats;
+
+    for (int i = 0; i < options.frames; i++)
+    {
+        float f = options.frames > 1 ? (float)i / (options.frames - 1) : 0.0f;
+        cam_position = glm::mix(options.cam_position, options.cam_position_end, f);
+        cam_rot = glm::radians(glm::mix(options.cam_rot, options.cam_rot_end, f));
+        update_camera_direction();
+        update_image_plane();
+        renderer.setCamera(cam_position, img_origin, img_right, img_up);
+
+        std::string path = frame_output_path(options, i);
+        CpuRenderer::Stats stats;
+        uint64_t bytes_written = 0;
+
+        auto frame_start = clock::now();
+        if (options.stream_rows > 0)
+        {
+            // rendering and writing are interleaved, so the frame time includes the output
+            if (!render_streamed(renderer, options, threads, path, stats, bytes_written)) return -1;
+        }
+        else
+        {
+            stats = renderer.render(frame, options.samples, threads);
+        }
+        double frame_ms = std::chrono::duration<double, std::milli>(clock::now() - frame_start).count();
+
+        if (options.stream_rows == 0 && !frame.save(path)) return -1;
+
+        uint64_t rays = stats.rays + stats.shadow_rays;
+        std::cout << "Frame " << i << ": " << frame_ms << " ms, " << rays / (frame_ms * 1e3) << " Mrays/s, "
+                  << (double)options.width * options.height / (frame_ms * 1e3) << " Mpixels/s";
+        if (options.stream_rows > 0) std::cout << ", " << bytes_written / (frame_ms * 1e3) << " MB/s written";
+        std::cout << " -> " << path << std::endl;
+
+        total_ms += frame_ms;
+        total_rays += rays;
+        total_stats += stats;
+        min_ms = i == 0 ? frame_ms : std::min(min_ms, frame_ms);
+        max_ms = std::max(max_ms, frame_ms);
+    }
+
+    std::cout << "Total: " << total_ms << " ms, frame min/avg/max " << min_ms << "/" << total_ms / options.frames << "/" << max_ms
+              << " ms, " << total_rays / (total_ms * 1e3) << " Mrays/s" << std::endl;
+
+    uint64_t primary_rays = (uint64_t)options.width * options.height * options.samples * options.frames;
+    double pixels = (double)options.width * options.height * options.frames;
+    std::cout << "Rays per pixel: " << total_stats.rays / pixels << " (" << (double)total_stats.rays / primary_rays << " per sample), "
+              << total_stats.shadow_rays / pixels << " shadow rays" << std::endl;
+    std::cout << "BVH node visits: " << (double)total_stats.primary_node_visits / primary_rays << " per primary ray, "
+              << (double)total_stats.secondary_node_visits / std::max<uint64_t>(1, total_stats.rays - primary_rays) << " per secondary ray, "
+              << (double)total_stats.shadow_node_visits / std::max<uint64_t>(1, total_stats.shadow_rays) << " per shadow ray" << std::endl;
+    if (options.packet_traversal)
+    {
+        std::cout << "Packets: " << total_stats.packets << " traced, " << total_stats.packet_fallbacks << " tiles fell back to per-ray traversal" << std::endl;
+    }
+    if (options.shadow_packets)
+    {
+        std::cout << "Shadow packets: " << total_stats.shadow_packets << " traced" << std::endl;
+    }
+    std::cout << "Peak memory: " << peak_memory_usage() / (1024.0 * 1024.0) << " MB" << std::endl;
+
+    delete model;
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    HeadlessOptions options;
+    if (!parse_command_line(argc, argv, options))
+        return -1;
+
+    if (options.enabled)
+        return run_headless(options);
+
+    use_wavefront = options.wavefront;
+    aa_samples = options.aa_samples;
+    stochastic_paths = options.stochastic_paths;
+    use_visibility = options.hybrid;
+    history_length = options.history_length;
+    downscale = options.downscale;
+    secondary_downscale = options.secondary_downscale;
+    roulette_depth = options.roulette_depth;
+    mip_filter = options.kaiser_mips ? MipChain::Filter::Kaiser : MipChain::Filter::Box;
+    if (options.target_ms > 0.0f) governor = new FrameGovernor(options.target_ms);
+    timings_csv = options.timings_csv;
+    if (!options.shader_cache) Shader::setBinaryCacheDirectory("");
+
+    auto startup_start = std::chrono::steady_clock::now();
+
     if (!init())
         return -1;
 
     if (!loadContent())
         return -1;
 
+    const Shader::BuildStats& shader_stats = Shader::getBuildStats();
+    double startup_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startup_start).count();
+    std::cout << "Startup: " << startup_ms << " ms, shaders " << shader_stats.milliseconds << " ms (" << shader_stats.cached << " cached, "
+              << shader_stats.compiled << " compiled" << (options.shader_cache ? "" : ", cache disabled") << ")" << std::endl;
+
     update();
 
     glfwTerminate();
 
-    delete shader;
-    delete texture;
-    delete nmap;
-    delete modelTex;
+    delete wavefront;
+    delete accumulator;
+    delete edge_sampler;
+    delete visibility;
+    delete temporal_cache;
+    delete upscaler;
+    delete secondary_upsampler;
+    delete governor;
+    delete scene_buffers;
+    delete frame_uniforms;
+    delete gpu_timer;
+    delete tracer_variants;
+    delete scene_textures;
     delete model;
 
     return 0;
@@ -0,0 +1,83 @@
+#include "Accumulator.h"
+
+// first unit after the scene textures
+static const int TEXTURE_UNIT = 20;
+
+static float radical_inverse(unsigned index, unsigned base)
+{
+	float result = 0.0f;
+	float digit = 1.0f / base;
+	for (; index > 0; index /= base, digit /= base) result += digit * (index % base);
+	return result;
+}
+
+Accumulator::Accumulator()
+	: shader(nullptr), fbo(0), texture(0), width(0), height(0), frame_count(0)
+{
+	shader = new Shader("Basic.vert", "Blit.frag");
+	shader->setUniform1i("source", TEXTURE_UNIT);
+	output_size = shader->getUniform<glm::vec2>("output_size");
+	glGenFramebuffers(1, &fbo);
+}
+
+Accumulator::~Accumulator()
+{
+	glDeleteFramebuffers(1, &fbo);
+	if (texture != 0) glDeleteTextures(1, &texture);
+	delete shader;
+}
+
+glm::vec2 Accumulator::getJitter() const
+{
+	// Halton (2, 3) sequence, the first frame samples the pixel center
+	unsigned index = (unsigned)frame_count;
+	return glm::vec2(radical_inverse(index, 2), radical_inverse(index, 3)) - glm::vec2(index == 0 ? 0.0f : 0.5f);
+}
+
+void Accumulator::bind(int width, int height)
+{
+	if (width != this->width || height != this->height)
+	{
+		this->width = width;
+		this->height = height;
+
+		if (texture != 0) glDeleteTextures(1, &texture);
+		glGenTextures(1, &texture);
+		glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, width, height);
+		// for scaling up a reduced render size; a target of the window's size is copied texel by texel
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+		reset();
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	if (frame_count == 0)
+	{
+		const GLfloat black[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		glClearBufferfv(GL_COLOR, 0, black);
+	}
+
+	// new average = old * n / (n + 1) + frame / (n + 1)
+	glEnable(GL_BLEND);
+	glBlendColor(0.0f, 0.0f, 0.0f, 1.0f / (frame_count + 1));
+	glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+	frame_count++;
+}
+
+void Accumulator::present(int width, int height)
+{
+	glDisable(GL_BLEND);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, width, height);
+
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	shader->apply();
+	bool same_size = width == this->width && height == this->height;
+	shader->set(output_size, same_size ? glm::vec2(0.0f) : glm::vec2((float)width, (float)height));
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <rendering/Shader.h>
+
+// Progressive refinement while the view is static: every frame is traced with a different subpixel jitter
+// into a float texture and blended into the running average, which converges to an anti-aliased image.
+class Accumulator
+{
+public:
+	// frames after which the image counts as converged and tracing stops until the next reset
+	static const int MAX_FRAMES = 256;
+
+	Accumulator();
+	~Accumulator();
+
+	// Starts over with the next frame; call when the camera, the scene or the pipeline changed.
+	void reset() { frame_count = 0; }
+
+	bool isConverged() const { return frame_count >= MAX_FRAMES; }
+	int getFrameCount() const { return frame_count; }
+
+	// Subpixel offset of the next frame in pixels, in [-0.5, 0.5).
+	glm::vec2 getJitter() const;
+
+	// Binds the float target (resized and reset if the render size changed) with blending set up
+	// to average the next full-screen pass into it.
+	void bind(int width, int height);
+
+	// Switches back to the default framebuffer of the given size and applies the shader that draws the
+	// average with a full-screen triangle pass, scaled up bilinearly if the target is smaller.
+	void present(int width, int height);
+
+	// the average, for presenting it with another filter
+	GLuint getTexture() const { return texture; }
+
+private:
+	Shader* shader;
+	Shader::Uniform<glm::vec2> output_size;
+	GLuint fbo;
+	GLuint texture;
+	int width;
+	int height;
+	int frame_count;
+};
@@ -0,0 +1,142 @@
+#include "AdaptiveSampler.h"
+
+#include <algorithm>
+
+// after the scene textures and the accumulation target
+static const int GEOMETRY_UNIT = 21;
+static const int OBJECT_UNIT = 22;
+static const int COLOR_UNIT = 23;
+// edge_pixel_count in Raytrace.frag
+static const int COUNTER_BINDING = 0;
+
+AdaptiveSampler::AdaptiveSampler()
+	: shader(nullptr), base_fbo(0), refine_fbo(0), color_texture(0), geometry_texture(0), object_texture(0), edge_counter(0), width(0), height(0), samples(4)
+{
+	shader = new Shader("Basic.vert", "Blit.frag");
+	shader->setUniform1i("source", COLOR_UNIT);
+	glGenFramebuffers(1, &base_fbo);
+	glGenFramebuffers(1, &refine_fbo);
+
+	GLuint zero = 0;
+	glGenBuffers(1, &edge_counter);
+	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, edge_counter);
+	glBufferData(GL_ATOMIC_COUNTER_BUFFER, sizeof(GLuint), &zero, GL_DYNAMIC_DRAW);
+}
+
+AdaptiveSampler::~AdaptiveSampler()
+{
+	glDeleteBuffers(1, &edge_counter);
+	glDeleteFramebuffers(1, &base_fbo);
+	glDeleteFramebuffers(1, &refine_fbo);
+	if (color_texture != 0)
+	{
+		GLuint textures[3] = { color_texture, geometry_texture, object_texture };
+		glDeleteTextures(3, textures);
+	}
+	delete shader;
+}
+
+void AdaptiveSampler::setUniforms(Shader& tracer)
+{
+	tracer.setUniform1i("edge_geometry", GEOMETRY_UNIT);
+	tracer.setUniform1i("edge_object", OBJECT_UNIT);
+	tracer_sampling = tracer.getUniform<int>("sampling");
+	tracer_edge_samples = tracer.getUniform<int>("edge_samples");
+}
+
+void AdaptiveSampler::setSampleBudget(int samples)
+{
+	this->samples = std::max(1, std::min(samples, MAX_SAMPLES));
+}
+
+void AdaptiveSampler::createTargets()
+{
+	if (color_texture != 0)
+	{
+		GLuint textures[3] = { color_texture, geometry_texture, object_texture };
+		glDeleteTextures(3, textures);
+	}
+
+	GLuint textures[3];
+	glGenTextures(3, textures);
+	color_texture = textures[0];
+	geometry_texture = textures[1];
+	object_texture = textures[2];
+
+	// on our own unit, the scene textures are bound already
+	glActiveTexture(GL_TEXTURE0 + COLOR_UNIT);
+	// normal and distance of the primary hit in geometry
+	const GLenum formats[3] = { GL_RGBA16F, GL_RGBA32F, GL_R32UI };
+	for (int i = 0; i < 3; i++)
+	{
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+		glTexStorage2D(GL_TEXTURE_2D, 1, formats[i], width, height);
+		// integer textures are incomplete with linear filtering
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+
+	// the refine pass samples geometry and object while it writes color, so it gets its own framebuffer
+	glBindFramebuffer(GL_FRAMEBUFFER, base_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color_texture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, geometry_texture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, object_texture, 0);
+	const GLenum draw_buffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+	glDrawBuffers(3, draw_buffers);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, refine_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color_texture, 0);
+}
+
+void AdaptiveSampler::bindBase(Shader& tracer, int width, int height)
+{
+	if (width != this->width || height != this->height)
+	{
+		this->width = width;
+		this->height = height;
+		createTargets();
+	}
+
+	glDisable(GL_BLEND);
+	glBindFramebuffer(GL_FRAMEBUFFER, base_fbo);
+	tracer.set(tracer_sampling, SAMPLING_EDGE_BASE);
+}
+
+void AdaptiveSampler::bindRefine(Shader& tracer)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, refine_fbo);
+
+	glActiveTexture(GL_TEXTURE0 + GEOMETRY_UNIT);
+	glBindTexture(GL_TEXTURE_2D, geometry_texture);
+	glActiveTexture(GL_TEXTURE0 + OBJECT_UNIT);
+	glBindTexture(GL_TEXTURE_2D, object_texture);
+
+	tracer.set(tracer_sampling, SAMPLING_EDGE_REFINE);
+	tracer.set(tracer_edge_samples, samples);
+
+	// result = refine mean * n / (n + 1) + base sample / (n + 1)
+	glEnable(GL_BLEND);
+	glBlendColor(0.0f, 0.0f, 0.0f, (float)samples / (samples + 1));
+	glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+
+	GLuint zero = 0;
+	glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, COUNTER_BINDING, edge_counter);
+	glBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(GLuint), &zero);
+}
+
+void AdaptiveSampler::present()
+{
+	glDisable(GL_BLEND);
+
+	glActiveTexture(GL_TEXTURE0 + COLOR_UNIT);
+	glBindTexture(GL_TEXTURE_2D, color_texture);
+	shader->apply();
+}
+
+unsigned AdaptiveSampler::getEdgePixels()
+{
+	GLuint edge_pixels = 0;
+	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, edge_counter);
+	glGetBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(GLuint), &edge_pixels);
+	return edge_pixels;
+}
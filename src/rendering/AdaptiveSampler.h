@@ -0,0 +1,66 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <rendering/Shader.h>
+
+// Sample placement of Raytrace.frag, mirrors its SAMPLING_* defines.
+enum RaytraceSampling
+{
+	SAMPLING_MULTISAMPLE = 0,
+	SAMPLING_JITTER = 1,
+	SAMPLING_EDGE_BASE = 2,
+	SAMPLING_EDGE_REFINE = 3,
+	SAMPLING_SECONDARY = 4
+};
+
+// Adaptive anti-aliasing for the fragment tracer: a base pass traces one sample per pixel into a
+// single-sampled target together with the primary hit, then a refine pass spends the sample budget
+// only on pixels next to a depth, normal or object discontinuity. This replaces shading every sample
+// of the multisampled framebuffer, which doubles the cost of every pixel.
+class AdaptiveSampler
+{
+public:
+	static const int MAX_SAMPLES = 16;
+
+	AdaptiveSampler();
+	~AdaptiveSampler();
+
+	// Assigns the texture units of the edge inputs in a tracer program; they must differ from the scene
+	// textures' even while unused, since samplers of different types may not share a unit.
+	// The passes below must be given the tracer of the last call.
+	void setUniforms(Shader& tracer);
+
+	// Extra samples traced per edge pixel, clamped to 1 .. MAX_SAMPLES.
+	void setSampleBudget(int samples);
+	int getSampleBudget() const { return samples; }
+
+	// Binds the targets of the base pass (resized if the window size changed) and selects it in the tracer.
+	void bindBase(Shader& tracer, int width, int height);
+
+	// Binds the color target with blending set up to average the refine samples with the base sample,
+	// and the base pass results as inputs of the tracer's edge test.
+	void bindRefine(Shader& tracer);
+
+	// Ends the refine pass and applies the shader that copies the anti-aliased image; bind the
+	// target framebuffer and draw a full-screen pass afterwards.
+	void present();
+
+	// Pixels refined in the last adaptive frame; waits for the frame to finish.
+	unsigned getEdgePixels();
+
+private:
+	Shader* shader;
+	Shader::Uniform<int> tracer_sampling;
+	Shader::Uniform<int> tracer_edge_samples;
+	GLuint base_fbo;
+	GLuint refine_fbo;
+	GLuint color_texture;
+	GLuint geometry_texture;
+	GLuint object_texture;
+	GLuint edge_counter;
+	int width;
+	int height;
+	int samples;
+
+	void createTargets();
+};
@@ -0,0 +1,65 @@
+#include "BilateralUpscaler.h"
+
+// after the temporal cache: source, then object and depth of the render size and of the window size guide
+static const int FIRST_UNIT = 28;
+static const int INPUT_COUNT = 5;
+static const char* INPUTS[INPUT_COUNT] = { "source", "low_object", "low_depth", "guide_object", "guide_depth" };
+
+BilateralUpscaler::BilateralUpscaler()
+	: shader(nullptr), low_guide(nullptr), guide(nullptr), guides_valid(false), render_width(0), render_height(0), width(0), height(0),
+	  sphere_count(0), triangle_count(0)
+{
+	shader = new Shader("Basic.vert", "Upscale.frag");
+	for (int i = 0; i < INPUT_COUNT; i++) shader->setUniform1i(INPUTS[i], FIRST_UNIT + i);
+	output_size = shader->getUniform<glm::vec2>("output_size");
+
+	low_guide = new VisibilityBuffer(true);
+	guide = new VisibilityBuffer(true);
+}
+
+BilateralUpscaler::~BilateralUpscaler()
+{
+	delete guide;
+	delete low_guide;
+	delete shader;
+}
+
+void BilateralUpscaler::setGroundPlane(const glm::vec4& plane)
+{
+	shader->setUniform4fv("ground_plane", plane);
+}
+
+void BilateralUpscaler::present(GLuint source, int render_width, int render_height, int width, int height, unsigned sphere_count, unsigned triangle_count)
+{
+	glDisable(GL_BLEND);
+
+	// a static view keeps its guides, only the source changes while it converges
+	if (!guides_valid || render_width != this->render_width || render_height != this->render_height || width != this->width ||
+		height != this->height || sphere_count != this->sphere_count || triangle_count != this->triangle_count)
+	{
+		glViewport(0, 0, render_width, render_height);
+		low_guide->render(render_width, render_height, sphere_count, triangle_count);
+		glViewport(0, 0, width, height);
+		guide->render(width, height, sphere_count, triangle_count);
+
+		guides_valid = true;
+		this->render_width = render_width;
+		this->render_height = render_height;
+		this->width = width;
+		this->height = height;
+		this->sphere_count = sphere_count;
+		this->triangle_count = triangle_count;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, width, height);
+	const GLuint textures[INPUT_COUNT] = { source, low_guide->getObjectTexture(), low_guide->getDepthTexture(), guide->getObjectTexture(), guide->getDepthTexture() };
+	for (int i = 0; i < INPUT_COUNT; i++)
+	{
+		glActiveTexture(GL_TEXTURE0 + FIRST_UNIT + i);
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+	}
+
+	shader->apply();
+	shader->set(output_size, glm::vec2((float)width, (float)height));
+}
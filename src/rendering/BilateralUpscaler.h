@@ -0,0 +1,41 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <rendering/Shader.h>
+#include <rendering/VisibilityBuffer.h>
+
+// Edge-aware upscaling of a render traced at a reduced size. Two guide visibility buffers, one of the render
+// size and one of the window size, give the object and hit distance seen through every pixel center; from them
+// Upscale.frag rebuilds depth and normal and blends each window pixel from the render pixels that see the same
+// surface, so silhouettes and creases stay sharp where bilinear filtering would blur them.
+class BilateralUpscaler
+{
+public:
+	BilateralUpscaler();
+	~BilateralUpscaler();
+
+	void setGroundPlane(const glm::vec4& plane);
+
+	// Rasterizes both guides again with the next present; call when the camera or the scene changed.
+	void reset() { guides_valid = false; }
+
+	// Rasterizes both guides if they were reset or a size or object count changed, then switches to the default
+	// framebuffer of the window size and applies the filter that draws the source texture, a render of the render
+	// size, with a full-screen triangle pass.
+	void present(GLuint source, int render_width, int render_height, int width, int height, unsigned sphere_count, unsigned triangle_count);
+
+private:
+	Shader* shader;
+	Shader::Uniform<glm::vec2> output_size;
+	VisibilityBuffer* low_guide;
+	VisibilityBuffer* guide;
+	// what the guides were rasterized for
+	bool guides_valid;
+	int render_width;
+	int render_height;
+	int width;
+	int height;
+	unsigned sphere_count;
+	unsigned triangle_count;
+};
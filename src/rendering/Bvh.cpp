@@ -0,0 +1,149 @@
+#include "Bvh.h"
+
+#include <algorithm>
+#include <limits>
+
+static const int SAH_BINS = 12;
+
+static float surface_area(const glm::vec3& bounds_min, const glm::vec3& bounds_max)
+{
+	glm::vec3 extent = glm::max(bounds_max - bounds_min, 0.0f);
+	return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+void Bvh::build(const std::vector<Vertex>& vertices, const std::vector<Triangle>& triangles)
+{
+	nodes.clear();
+	indices.resize(triangles.size());
+	if (triangles.empty()) return;
+
+	std::vector<glm::vec3> bounds_min(triangles.size());
+	std::vector<glm::vec3> bounds_max(triangles.size());
+	std::vector<glm::vec3> centroids(triangles.size());
+
+	for (unsigned i = 0; i < triangles.size(); i++)
+	{
+		const glm::vec3& p1 = vertices[triangles[i].indices.x].position;
+		const glm::vec3& p2 = vertices[triangles[i].indices.y].position;
+		const glm::vec3& p3 = vertices[triangles[i].indices.z].position;
+		bounds_min[i] = glm::min(p1, glm::min(p2, p3));
+		bounds_max[i] = glm::max(p1, glm::max(p2, p3));
+		centroids[i] = (bounds_min[i] + bounds_max[i]) * 0.5f;
+		indices[i] = i;
+	}
+
+	nodes.reserve(2 * triangles.size());
+	nodes.push_back(Node());
+	nodes[0].first = 0;
+	nodes[0].count = (unsigned)triangles.size();
+	subdivide(0, 0, bounds_min, bounds_max, centroids);
+}
+
+void Bvh::subdivide(unsigned node_index, int depth, const std::vector<glm::vec3>& bounds_min, const std::vector<glm::vec3>& bounds_max, const std::vector<glm::vec3>& centroids)
+{
+	unsigned first = nodes[node_index].first;
+	unsigned count = nodes[node_index].count;
+
+	glm::vec3 node_min(std::numeric_limits<float>::max());
+	glm::vec3 node_max(-std::numeric_limits<float>::max());
+	glm::vec3 centroid_min = node_min;
+	glm::vec3 centroid_max = node_max;
+	for (unsigned i = first; i < first + count; i++)
+	{
+		unsigned tri = indices[i];
+		node_min = glm::min(node_min, bounds_min[tri]);
+		node_max = glm::max(node_max, bounds_max[tri]);
+		centroid_min = glm::min(centroid_min, centroids[tri]);
+		centroid_max = glm::max(centroid_max, centroids[tri]);
+	}
+	nodes[node_index].bounds_min = node_min;
+	nodes[node_index].bounds_max = node_max;
+
+	// skewed input, such as exponentially spaced centroids, would otherwise split one triangle off at a time
+	if (count <= MAX_LEAF_SIZE || depth == MAX_DEPTH) return;
+
+	// binned SAH over all three axes
+	int best_axis = -1;
+	int best_split = 0;
+	float best_cost = count * surface_area(node_min, node_max);
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float extent = centroid_max[axis] - centroid_min[axis];
+		if (extent <= 0.0f) continue;
+
+		glm::vec3 bin_min[SAH_BINS], bin_max[SAH_BINS];
+		unsigned bin_count[SAH_BINS] = { 0 };
+		for (int b = 0; b < SAH_BINS; b++)
+		{
+			bin_min[b] = glm::vec3(std::numeric_limits<float>::max());
+			bin_max[b] = glm::vec3(-std::numeric_limits<float>::max());
+		}
+
+		float scale = SAH_BINS / extent;
+		for (unsigned i = first; i < first + count; i++)
+		{
+			unsigned tri = indices[i];
+			int b = std::min(SAH_BINS - 1, (int)((centroids[tri][axis] - centroid_min[axis]) * scale));
+			bin_count[b]++;
+			bin_min[b] = glm::min(bin_min[b], bounds_min[tri]);
+			bin_max[b] = glm::max(bin_max[b], bounds_max[tri]);
+		}
+
+		float right_area[SAH_BINS];
+		unsigned right_count[SAH_BINS];
+		glm::vec3 acc_min(std::numeric_limits<float>::max()), acc_max(-std::numeric_limits<float>::max());
+		unsigned acc_count = 0;
+		for (int b = SAH_BINS - 1; b > 0; b--)
+		{
+			acc_min = glm::min(acc_min, bin_min[b]);
+			acc_max = glm::max(acc_max, bin_max[b]);
+			acc_count += bin_count[b];
+			right_area[b] = surface_area(acc_min, acc_max);
+			right_count[b] = acc_count;
+		}
+
+		acc_min = glm::vec3(std::numeric_limits<float>::max());
+		acc_max = glm::vec3(-std::numeric_limits<float>::max());
+		acc_count = 0;
+		for (int b = 0; b < SAH_BINS - 1; b++)
+		{
+			acc_min = glm::min(acc_min, bin_min[b]);
+			acc_max = glm::max(acc_max, bin_max[b]);
+			acc_count += bin_count[b];
+			if (acc_count == 0 || right_count[b + 1] == 0) continue;
+
+			float cost = acc_count * surface_area(acc_min, acc_max) + right_count[b + 1] * right_area[b + 1];
+			if (cost < best_cost)
+			{
+				best_cost = cost;
+				best_axis = axis;
+				best_split = b + 1;
+			}
+		}
+	}
+
+	if (best_axis < 0) return;
+
+	float split_scale = SAH_BINS / (centroid_max[best_axis] - centroid_min[best_axis]);
+	auto middle = std::partition(indices.begin() + first, indices.begin() + first + count, [&](unsigned tri)
+	{
+		return std::min(SAH_BINS - 1, (int)((centroids[tri][best_axis] - centroid_min[best_axis]) * split_scale)) < best_split;
+	});
+	unsigned left_count = (unsigned)(middle - indices.begin()) - first;
+	if (left_count == 0 || left_count == count) return;
+
+	unsigned left = (unsigned)nodes.size();
+	nodes.push_back(Node());
+	nodes.push_back(Node());
+	nodes[left].first = first;
+	nodes[left].count = left_count;
+	nodes[left + 1].first = first + left_count;
+	nodes[left + 1].count = count - left_count;
+
+	nodes[node_index].first = left;
+	nodes[node_index].count = 0;
+
+	subdivide(left, depth + 1, bounds_min, bounds_max, centroids);
+	subdivide(left + 1, depth + 1, bounds_min, bounds_max, centroids);
+}
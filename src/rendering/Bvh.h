@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include <rendering/SceneObjects.h>
+
+// Bounding volume hierarchy over the scene triangles, built with binned SAH for the CPU tracer.
+class Bvh
+{
+public:
+	static const unsigned MAX_LEAF_SIZE = 4;
+	// nodes this deep stay leaves whatever their size, so traversal stacks can have a fixed size: a ray's stack
+	// holds at most one pending sibling per level above the node it visits, plus that node's two children
+	static const int MAX_DEPTH = 62;
+	static const int MAX_STACK_SIZE = MAX_DEPTH + 1;
+
+	// Interior nodes have count == 0 and their children at first and first + 1,
+	// leaves reference count triangle indices starting at first.
+	struct Node
+	{
+		glm::vec3 bounds_min;
+		unsigned first;
+		glm::vec3 bounds_max;
+		unsigned count;
+	};
+
+	Bvh() : nodes(), indices() {}
+
+	void build(const std::vector<Vertex>& vertices, const std::vector<Triangle>& triangles);
+
+	const std::vector<Node>& getNodes() const { return nodes; }
+	const std::vector<unsigned>& getIndices() const { return indices; }
+
+private:
+	std::vector<Node> nodes;
+	std::vector<unsigned> indices;
+
+	void subdivide(unsigned node_index, int depth, const std::vector<glm::vec3>& bounds_min, const std::vector<glm::vec3>& bounds_max, const std::vector<glm::vec3>& centroids);
+};
@@ -0,0 +1,920 @@
+#include "CpuRenderer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+static const float INFINITY_F = std::numeric_limits<float>::infinity();
+static const float EPSILON = 1e-4f;
+static const float PI = 3.14159265359f;
+static const float TWOPI = 2.0f * PI;
+static const float MAX_PACKET_SPREAD_COS = 0.9962f; // 5 degrees
+static const float ROULETTE_THROUGHPUT = 0.5f;
+
+static float radical_inverse(unsigned i)
+{
+	i = (i << 16) | (i >> 16);
+	i = ((i & 0x55555555u) << 1) | ((i & 0xAAAAAAAAu) >> 1);
+	i = ((i & 0x33333333u) << 2) | ((i & 0xCCCCCCCCu) >> 2);
+	i = ((i & 0x0F0F0F0Fu) << 4) | ((i & 0xF0F0F0F0u) >> 4);
+	i = ((i & 0x00FF00FFu) << 8) | ((i & 0xFF00FF00u) >> 8);
+	return i * 2.3283064365386963e-10f;
+}
+
+static glm::vec3 phong_lighting(const glm::vec3& view_dir, const glm::vec3& normal, const Material& material,
+								const glm::vec3& light_dir, const glm::vec3& light_color, float light_intensity)
+{
+	glm::vec3 result = material.ambient * light_color * light_intensity;
+
+	float normal_dot_light_dir = glm::dot(normal, -light_dir);
+
+	if (normal_dot_light_dir > 0.0f)
+	{
+		result += glm::vec3(material.diffuse) * light_color * (light_intensity * normal_dot_light_dir);
+
+		float reflection_dot_view = glm::dot(glm::reflect(light_dir, normal), view_dir);
+		if (reflection_dot_view > 0)
+		{
+			result += glm::vec3(material.specular) * light_color * (light_intensity * std::pow(reflection_dot_view, material.specular.w));
+		}
+	}
+
+	return result * material.diffuse.a;
+}
+
+static float color_sum(const glm::vec3& c)
+{
+	return c.r + c.g + c.b;
+}
+
+static unsigned pcg_hash(unsigned value)
+{
+	unsigned state = value * 747796405u + 2891336453u;
+	unsigned word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+static unsigned float_bits(float value)
+{
+	unsigned bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static glm::vec3 safe_inverse(const glm::vec3& d)
+{
+	const float tiny = 1e-20f;
+	return 1.0f / glm::vec3(std::abs(d.x) < tiny ? std::copysign(tiny, d.x) : d.x,
+							std::abs(d.y) < tiny ? std::copysign(tiny, d.y) : d.y,
+							std::abs(d.z) < tiny ? std::copysign(tiny, d.z) : d.z);
+}
+
+// slab test of a ray segment [0, t_max] against an axis-aligned box
+static bool box_intersect(const glm::vec3& bounds_min, const glm::vec3& bounds_max, const glm::vec3& origin, const glm::vec3& inv_dir, float t_max, float& t_near)
+{
+	glm::vec3 t0 = (bounds_min - origin) * inv_dir;
+	glm::vec3 t1 = (bounds_max - origin) * inv_dir;
+	glm::vec3 t_small = glm::min(t0, t1);
+	glm::vec3 t_large = glm::max(t0, t1);
+	t_near = std::max(std::max(t_small.x, t_small.y), std::max(t_small.z, 0.0f));
+	float t_far = std::min(std::min(t_large.x, t_large.y), std::min(t_large.z, t_max));
+	return t_near <= t_far;
+}
+
+// distance from a point to the closest point of an axis-aligned box
+static float box_distance(const glm::vec3& bounds_min, const glm::vec3& bounds_max, const glm::vec3& point)
+{
+	glm::vec3 d = glm::max(glm::max(bounds_min - point, point - bounds_max), 0.0f);
+	return glm::length(d);
+}
+
+// pushes both children of an interior node so that the one closer to the origin is popped first
+static void push_children(const std::vector<Bvh::Node>& nodes, const Bvh::Node& node, const glm::vec3& origin, unsigned* stack, int& stack_size)
+{
+	const Bvh::Node& left = nodes[node.first];
+	const Bvh::Node& right = nodes[node.first + 1];
+	float left_dist = box_distance(left.bounds_min, left.bounds_max, origin);
+	float right_dist = box_distance(right.bounds_min, right.bounds_max, origin);
+	if (left_dist < right_dist)
+	{
+		stack[stack_size++] = node.first + 1;
+		stack[stack_size++] = node.first;
+	}
+	else
+	{
+		stack[stack_size++] = node.first;
+		stack[stack_size++] = node.first + 1;
+	}
+}
+
+void CpuRenderer::updateScene()
+{
+	bvh.build(vertices, triangles);
+
+	opaque_triangles.resize(triangles.size());
+	for (size_t i = 0; i < triangles.size(); i++)
+	{
+		const glm::uvec3& idx = triangles[i].indices;
+		opaque_triangles[i] = vertices[idx.x].material.diffuse.a >= 1.0f && vertices[idx.y].material.diffuse.a >= 1.0f && vertices[idx.z].material.diffuse.a >= 1.0f;
+	}
+}
+
+void CpuRenderer::setCamera(const glm::vec3& position, const glm::vec3& origin, const glm::vec3& right, const glm::vec3& up)
+{
+	cam_pos = position;
+	img_origin = origin;
+	img_right = right;
+	img_up = up;
+}
+
+CpuRenderer::Stats& CpuRenderer::Stats::operator+=(const Stats& other)
+{
+	rays += other.rays;
+	shadow_rays += other.shadow_rays;
+	primary_node_visits += other.primary_node_visits;
+	secondary_node_visits += other.secondary_node_visits;
+	shadow_node_visits += other.shadow_node_visits;
+	packets += other.packets;
+	packet_fallbacks += other.packet_fallbacks;
+	shadow_packets += other.shadow_packets;
+	return *this;
+}
+
+bool CpuRenderer::Frustum::intersects(const glm::vec3& bounds_min, const glm::vec3& bounds_max) const
+{
+	for (int i = 0; i < 4; i++)
+	{
+		// the box corner furthest along the plane normal decides whether the box is fully outside
+		const glm::vec3& n = normals[i];
+		glm::vec3 corner(n.x > 0.0f ? bounds_max.x : bounds_min.x, n.y > 0.0f ? bounds_max.y : bounds_min.y, n.z > 0.0f ? bounds_max.z : bounds_min.z);
+		if (glm::dot(n, corner - origin) < 0.0f) return false;
+	}
+	return true;
+}
+
+CpuRenderer::Stats CpuRenderer::renderRows(Image& band, int first_row, int image_height, int samples, int threads) const
+{
+	int tiles_x = (band.width + TILE_SIZE - 1) / TILE_SIZE;
+	int tiles_y = (band.height + TILE_SIZE - 1) / TILE_SIZE;
+	int tile_count = tiles_x * tiles_y;
+
+	if (threads < 1) threads = 1;
+	if (samples < 1) samples = 1;
+
+	std::atomic<int> next_tile(0);
+	std::vector<Stats> thread_stats(threads);
+	std::vector<std::thread> workers;
+
+	for (int i = 0; i < threads; i++)
+	{
+		workers.emplace_back([&, i]()
+		{
+			int tile;
+			while ((tile = next_tile++) < tile_count)
+			{
+				renderTile(band, first_row, image_height, tile % tiles_x, tile / tiles_x, samples, thread_stats[i]);
+			}
+		});
+	}
+
+	Stats stats;
+	for (int i = 0; i < threads; i++)
+	{
+		workers[i].join();
+		stats += thread_stats[i];
+	}
+
+	return stats;
+}
+
+void CpuRenderer::renderTile(Image& band, int first_row, int image_height, int tile_x, int tile_y, int samples, Stats& stats) const
+{
+	glm::vec2 pixel_size(1.0f / band.width, 1.0f / image_height);
+	int x_start = tile_x * TILE_SIZE;
+	int y_start = first_row + tile_y * TILE_SIZE;
+	int tile_width = std::min(band.width, x_start + TILE_SIZE) - x_start;
+	int tile_height = std::min(first_row + band.height, y_start + TILE_SIZE) - y_start;
+	int count = tile_width * tile_height;
+
+	Frustum frustum;
+	bool use_packet = false;
+	if (traversal == Traversal::Packet)
+	{
+		use_packet = makeTileFrustum(glm::vec2(x_start, y_start) * pixel_size, glm::vec2(x_start + tile_width, y_start + tile_height) * pixel_size, frustum);
+		if (!use_packet) stats.packet_fallbacks++;
+	}
+
+	Ray rays[PACKET_SIZE];
+	Hit hits[PACKET_SIZE];
+	glm::vec3 colors[PACKET_SIZE];
+	for (int p = 0; p < count; p++) colors[p] = glm::vec3(0.0f);
+
+	Surface surfaces[PACKET_SIZE];
+	glm::vec3 shadow_origins[PACKET_SIZE];
+	bool shadow_active[PACKET_SIZE];
+	std::vector<Shadow> shadows(shadow_packets ? count * lights.size() : 0);
+
+	for (int s = 0; s < samples; s++)
+	{
+		glm::vec2 offset = samples == 1 ? glm::vec2(0.5f) : glm::vec2((s + 0.5f) / samples, radical_inverse(s));
+
+		for (int p = 0; p < count; p++)
+		{
+			glm::vec2 sample_pos = (glm::vec2(x_start + p % tile_width, y_start + p / tile_width) + offset) * pixel_size;
+			glm::vec3 ray_target = img_origin + sample_pos.x * img_right + sample_pos.y * img_up;
+			rays[p].origin = cam_pos;
+			rays[p].direction = glm::normalize(ray_target - cam_pos);
+			rays[p].color_mult = glm::vec3(1.0f);
+			rays[p].depth = 0;
+			rays[p].transmitted = false;
+		}
+
+		if (use_packet)
+		{
+			stats.packets++;
+			tracePacket(rays, hits, count, frustum, stats);
+		}
+		else
+		{
+			for (int p = 0; p < count; p++) trace(rays[p], hits[p], stats.primary_node_visits);
+		}
+
+		if (shadow_packets)
+		{
+			for (int p = 0; p < count; p++)
+			{
+				shadow_active[p] = hits[p].valid;
+				if (!hits[p].valid) continue;
+				getObjectProperties(hits[p].object, hits[p].position, hits[p].bary, surfaces[p].material, surfaces[p].normal);
+				shadow_origins[p] = hits[p].position + EPSILON * surfaces[p].normal;
+			}
+
+			for (size_t l = 0; l < lights.size(); l++)
+			{
+				bool batched = lights[l].type == 1 && lights[l].intensity >= EPSILON;
+				if (batched) traceShadowPacket(shadow_origins, shadow_active, -100.0f * lights[l].direction, count, &shadows[l], (int)lights.size(), stats);
+				else for (int p = 0; p < count; p++) shadows[p * lights.size() + l].traced = false;
+			}
+		}
+
+		for (int p = 0; p < count; p++)
+		{
+			if (shadow_packets && hits[p].valid) colors[p] += renderSample(rays[p], hits[p], &surfaces[p], &shadows[p * lights.size()], (unsigned)s, stats);
+			else colors[p] += renderSample(rays[p], hits[p], nullptr, nullptr, (unsigned)s, stats);
+		}
+	}
+
+	for (int p = 0; p < count; p++)
+	{
+		band.at(x_start + p % tile_width, y_start - first_row + p / tile_width) = glm::vec4(colors[p] / (float)samples, 1.0f);
+	}
+}
+
+bool CpuRenderer::makeTileFrustum(const glm::vec2& tile_min, const glm::vec2& tile_max, Frustum& frustum) const
+{
+	glm::vec3 corners[4] = {
+		img_origin + tile_min.x * img_right + tile_min.y * img_up - cam_pos,
+		img_origin + tile_max.x * img_right + tile_min.y * img_up - cam_pos,
+		img_origin + tile_max.x * img_right + tile_max.y * img_up - cam_pos,
+		img_origin + tile_min.x * img_right + tile_max.y * img_up - cam_pos
+	};
+	glm::vec3 center = glm::normalize(corners[0] + corners[1] + corners[2] + corners[3]);
+
+	// a packet spanning a wide angle culls almost nothing, so those tiles are traced per ray
+	for (int i = 0; i < 4; i++)
+	{
+		if (glm::dot(glm::normalize(corners[i]), center) < MAX_PACKET_SPREAD_COS) return false;
+	}
+
+	frustum.origin = cam_pos;
+	for (int i = 0; i < 4; i++)
+	{
+		glm::vec3 n = glm::cross(corners[i], corners[(i + 1) % 4]);
+		frustum.normals[i] = glm::dot(n, center) < 0.0f ? -n : n;
+	}
+	return true;
+}
+
+void CpuRenderer::tracePacket(const Ray* rays, Hit* hits, int count, const Frustum& frustum, Stats& stats) const
+{
+	// the packet's far bound is the largest closest-hit distance of any of its rays
+	float packet_t = 0.0f;
+	glm::vec3 inv_dirs[PACKET_SIZE];
+	for (int i = 0; i < count; i++)
+	{
+		traceAnalytic<FaceMode::Front>(rays[i], hits[i]);
+		inv_dirs[i] = safe_inverse(rays[i].direction);
+		packet_t = std::max(packet_t, hits[i].t);
+	}
+
+	const std::vector<Bvh::Node>& nodes = bvh.getNodes();
+	const std::vector<unsigned>& indices = bvh.getIndices();
+	if (nodes.empty()) return;
+
+	unsigned stack[BVH_STACK_SIZE];
+	int stack_size = 0;
+	stack[stack_size++] = 0;
+
+	while (stack_size > 0)
+	{
+		const Bvh::Node& node = nodes[stack[--stack_size]];
+		stats.primary_node_visits++;
+
+		if (!frustum.intersects(node.bounds_min, node.bounds_max)) continue;
+		if (box_distance(node.bounds_min, node.bounds_max, frustum.origin) > packet_t) continue;
+
+		if (node.count == 0)
+		{
+			push_children(nodes, node, frustum.origin, stack, stack_size);
+			continue;
+		}
+
+		packet_t = 0.0f;
+		for (int i = 0; i < count; i++)
+		{
+			stats.primary_node_visits++;
+			float t_near;
+			if (box_intersect(node.bounds_min, node.bounds_max, rays[i].origin, inv_dirs[i], hits[i].t, t_near))
+			{
+				intersectLeaf<FaceMode::Front>(node, indices, rays[i], hits[i]);
+			}
+			packet_t = std::max(packet_t, hits[i].t);
+		}
+	}
+}
+
+bool CpuRenderer::keepRay(glm::vec3& color_mult, int depth, const glm::vec3& position, unsigned seed) const
+{
+	if (roulette_depth <= 0) return color_sum(color_mult) > 0.01f;
+	float throughput = std::max(color_mult.r, std::max(color_mult.g, color_mult.b));
+	if (depth < roulette_depth) return throughput > 0.0f;
+
+	float survival = std::min(throughput / ROULETTE_THROUGHPUT, 1.0f);
+	unsigned hash = pcg_hash(seed ^ pcg_hash(float_bits(position.x) ^ pcg_hash(float_bits(position.y) ^ pcg_hash(float_bits(position.z)))));
+	if ((hash >> 8) * (1.0f / 16777216.0f) >= survival) return false;
+
+	color_mult /= survival;
+	return true;
+}
+
+glm::vec3 CpuRenderer::renderSample(const Ray& start_ray, const Hit& start_hit, const Surface* start_surface, const Shadow* start_shadows, unsigned seed, Stats& stats) const
+{
+	glm::vec3 color(0.0f);
+
+	Ray rays[MAX_RAYS];
+	int next_ray = 1;
+	for (int i = 1; i < MAX_RAYS; i++) rays[i].depth = -1;
+	rays[0] = start_ray;
+
+	glm::vec3 hit_pos, hit_normal, hit_color(0.0f);
+	Material hit_material;
+	bool backface, total_reflection;
+	Ray ray, trans_ray, refl_ray;
+	Hit hit;
+
+	for (int i = 0; i < MAX_RAYS; i++)
+	{
+		ray = rays[i];
+		if (ray.depth < 0) break;
+		if (i == 0) hit = start_hit;
+		else trace(ray, hit, stats.secondary_node_visits);
+		if (!castRay(ray, hit, i == 0 ? start_surface : nullptr, i == 0 ? start_shadows : nullptr, hit_color, hit_pos, hit_normal, hit_material, backface, stats)) continue;
+
+		if (!backface) color += ray.color_mult * hit_color;
+
+		if (ray.depth >= RECURSION_DEPTH - 1 || next_ray >= MAX_RAYS) continue;
+
+		if (hit_material.diffuse.a < 0.99f)
+		{
+			if (backface) trans_ray.color_mult = ray.color_mult;
+			else trans_ray.color_mult = ray.color_mult * glm::vec3(hit_material.diffuse) * (1.0f - hit_material.diffuse.a);
+
+			if (hit_material.eta != 1.0f)
+			{
+				if (backface) trans_ray.direction = glm::refract(ray.direction, -hit_normal, 1.0f / hit_material.eta);
+				else trans_ray.direction = glm::refract(ray.direction, hit_normal, hit_material.eta);
+				total_reflection = std::abs(trans_ray.direction.x) + std::abs(trans_ray.direction.y) + std::abs(trans_ray.direction.z) < 0.5f;
+			}
+			else
+			{
+				trans_ray.direction = ray.direction;
+				total_reflection = false;
+			}
+
+			if (!total_reflection && keepRay(trans_ray.color_mult, ray.depth + 1, hit_pos, 2u * seed))
+			{
+				if (backface) trans_ray.origin = hit_pos + EPSILON * hit_normal;
+				else trans_ray.origin = hit_pos - EPSILON * hit_normal;
+				trans_ray.depth = ray.depth + 1;
+				trans_ray.transmitted = true;
+				rays[next_ray++] = trans_ray;
+			}
+		}
+		else total_reflection = true;
+
+		if (next_ray < MAX_RAYS && color_sum(hit_material.reflective) > 0.01f)
+		{
+			glm::vec3 schlick_reflectivity = hit_material.reflective;
+			if (!total_reflection)
+			{
+				float normal_refl = (hit_material.eta - 1.0f) / (hit_material.eta + 1.0f);
+				schlick_reflectivity *= normal_refl * normal_refl;
+				float refl_scale = 1.0f - std::abs(glm::dot(hit_normal, ray.direction));
+				schlick_reflectivity += (1.0f - schlick_reflectivity) * (refl_scale * refl_scale * refl_scale * refl_scale * refl_scale);
+			}
+			refl_ray.color_mult = ray.color_mult * glm::mix(schlick_reflectivity, hit_material.reflective, hit_material.diffuse.a);
+
+			if (backface)
+			{
+				refl_ray.origin = hit_pos - EPSILON * hit_normal;
+				refl_ray.direction = glm::reflect(ray.direction, -hit_normal);
+			}
+			else
+			{
+				refl_ray.origin = hit_pos + EPSILON * hit_normal;
+				refl_ray.direction = glm::reflect(ray.direction, hit_normal);
+			}
+
+			if (keepRay(refl_ray.color_mult, ray.depth + 1, hit_pos, 2u * seed + 1u))
+			{
+				refl_ray.depth = ray.depth + 1;
+				refl_ray.transmitted = ray.transmitted;
+				rays[next_ray++] = refl_ray;
+			}
+		}
+	}
+
+	return color;
+}
+
+glm::vec4 CpuRenderer::sampleTexture(int index, const glm::vec2& uv) const
+{
+	if (index < 0 || index >= (int)textures.size()) return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+	// textures are uploaded as GL_RGB8, so alpha always reads as 1 on the GPU
+	return glm::vec4(glm::vec3(textures[index].sample(uv)), 1.0f);
+}
+
+void CpuRenderer::getObjectProperties(unsigned object, const glm::vec3& position, const glm::vec3& bary, Material& mat, glm::vec3& normal) const
+{
+	glm::vec2 uv(0.0f);
+
+	if (object == 0) //ground plane
+	{
+		mat.diffuse = glm::vec4(1.0f);
+		mat.ambient = glm::vec3(mat.diffuse);
+		mat.specular = glm::vec4(1.0f, 1.0f, 1.0f, 40.0f);
+		mat.emissive = mat.ambient / 15.0f;
+		mat.reflective = glm::vec3(0.0f);
+		mat.textures = glm::ivec4(0, -1, 0, -1);
+		uv = (glm::vec2(position.x, position.z) / 10.0f) - .25f;
+		glm::vec3 snormal = glm::vec3(ground_plane);
+		glm::vec3 tanx, tany;
+		if (snormal.x == 0.0f && snormal.z == 0.0f)
+		{
+			tanx = glm::vec3(1.0f, 0.0f, 0.0f);
+			tany = glm::vec3(0.0f, 0.0f, 1.0f);
+		}
+		else
+		{
+			tanx = glm::cross(glm::vec3(0.0f, 1.0f, 0.0f), snormal);
+			tany = glm::cross(snormal, tanx);
+		}
+		glm::vec3 map_normal = 2.0f * glm::vec3(sampleTexture(1, uv)) - 1.0f;
+		normal = glm::normalize(map_normal.x * tanx + map_normal.y * tany + map_normal.z * snormal);
+	}
+	else if (object <= spheres.size()) //sphere
+	{
+		const Sphere& sphere = spheres[object - 1];
+		mat = sphere.material;
+		glm::vec3 snormal = glm::normalize(position - glm::vec3(sphere.definition));
+		uv = glm::vec2(std::asin(snormal.x) / TWOPI, std::acos(snormal.y) / PI);
+		if (mat.normalmap < 0) normal = snormal;
+		else
+		{
+			glm::vec3 tanx, tany;
+			if (snormal.x == 0.0f && snormal.z == 0.0f)
+			{
+				tanx = glm::vec3(1.0f, 0.0f, 0.0f);
+				tany = glm::vec3(0.0f, 0.0f, 1.0f);
+			}
+			else
+			{
+				tanx = glm::cross(glm::vec3(0.0f, 1.0f, 0.0f), snormal);
+				tany = glm::cross(snormal, tanx);
+			}
+			glm::vec3 map_normal = 2.0f * glm::vec3(sampleTexture(mat.normalmap, uv)) - 1.0f;
+			normal = glm::normalize(map_normal.x * tanx + map_normal.y * tany + map_normal.z * snormal);
+		}
+	}
+	else
+	{
+		const Triangle& tri = triangles[object - spheres.size() - 1];
+		const Vertex& vert1 = vertices[tri.indices.x];
+		const Vertex& vert2 = vertices[tri.indices.y];
+		const Vertex& vert3 = vertices[tri.indices.z];
+
+		mat.ambient = bary.x * vert1.material.ambient + bary.y * vert2.material.ambient + bary.z * vert3.material.ambient;
+		mat.diffuse = bary.x * vert1.material.diffuse + bary.y * vert2.material.diffuse + bary.z * vert3.material.diffuse;
+		mat.specular = bary.x * vert1.material.specular + bary.y * vert2.material.specular + bary.z * vert3.material.specular;
+		mat.emissive = bary.x * vert1.material.emissive + bary.y * vert2.material.emissive + bary.z * vert3.material.emissive;
+		mat.reflective = bary.x * vert1.material.reflective + bary.y * vert2.material.reflective + bary.z * vert3.material.reflective;
+		mat.textures = vert1.material.textures;
+		mat.normalmap = vert1.material.normalmap;
+		mat.eta = bary.x * vert1.material.eta + bary.y * vert2.material.eta + bary.z * vert3.material.eta;
+
+		uv = bary.x * vert1.uv + bary.y * vert2.uv + bary.z * vert3.uv;
+
+		glm::vec3 snormal = glm::normalize(bary.x * vert1.normal + bary.y * vert2.normal + bary.z * vert3.normal);
+		if (mat.normalmap < 0 || tri.uvtrans == glm::mat2(0.0f, 0.0f, 0.0f, 0.0f)) normal = snormal;
+		else
+		{
+			glm::vec3 bar1 = vert2.position - vert1.position;
+			glm::vec3 bar2 = vert3.position - vert1.position;
+
+			glm::vec3 map_normal = 2.0f * glm::vec3(sampleTexture(mat.normalmap, uv)) - 1.0f;
+
+			glm::vec2 transformed_xy = tri.uvtrans * glm::vec2(map_normal);
+
+			normal = glm::normalize(transformed_xy.x * bar1 + transformed_xy.y * bar2 + map_normal.z * snormal);
+		}
+	}
+
+	if (mat.textures.x >= 0)
+	{
+		glm::vec4 texVal = sampleTexture(mat.textures.x, uv);
+		mat.ambient *= glm::vec3(texVal);
+		mat.diffuse *= texVal;
+	}
+	if (mat.textures.y >= 0) mat.specular = glm::vec4(glm::vec3(mat.specular) * glm::vec3(sampleTexture(mat.textures.y, uv)), mat.specular.w);
+	if (mat.textures.z >= 0) mat.emissive *= glm::vec3(sampleTexture(mat.textures.z, uv));
+	if (mat.textures.w >= 0) mat.reflective *= glm::vec3(sampleTexture(mat.textures.w, uv));
+}
+
+template<FaceMode Faces>
+void CpuRenderer::traceAnalytic(const Ray& ray, Hit& hit) const
+{
+	hit.t = INFINITY_F;
+	hit.valid = false;
+	hit.bary = glm::vec3(0.0f);
+	hit.backface = false;
+
+	float t_obj;
+	bool obj_backface;
+
+	if (plane_intersect<Faces>(ground_plane, ray.origin, ray.direction, t_obj, obj_backface) && t_obj < hit.t && t_obj > 0.0f)
+	{
+		hit.t = t_obj;
+		hit.valid = true;
+		hit.object = 0;
+		hit.backface = obj_backface;
+	}
+
+	// spheres are few and unbounded by the BVH, so they are tested linearly
+	for (unsigned i = 0; i < spheres.size(); i++)
+	{
+		const Sphere& sphere = spheres[i];
+		if (sphere.definition.w < EPSILON) continue;
+
+		if (sphere_intersect<HitMode::Closest, Faces>(sphere, ray.origin, ray.direction, t_obj, obj_backface) && t_obj < hit.t && t_obj > 0.0f)
+		{
+			hit.t = t_obj;
+			hit.valid = true;
+			hit.object = i + 1;
+			hit.backface = obj_backface;
+		}
+	}
+
+	if (hit.valid) hit.position = ray.origin + hit.t * ray.direction;
+}
+
+template<FaceMode Faces>
+void CpuRenderer::intersectLeaf(const Bvh::Node& node, const std::vector<unsigned>& indices, const Ray& ray, Hit& hit) const
+{
+	float t_obj;
+	bool obj_backface;
+	glm::vec3 obj_bary;
+
+	for (unsigned j = node.first; j < node.first + node.count; j++)
+	{
+		unsigned i = indices[j];
+		if (triangle_intersect<Faces, true>(triangles[i], ray.origin, ray.direction, t_obj, obj_bary, obj_backface) && t_obj < hit.t && t_obj > 0.0f)
+		{
+			hit.t = t_obj;
+			hit.position = ray.origin + t_obj * ray.direction;
+			hit.valid = true;
+			hit.object = i + (unsigned)spheres.size() + 1;
+			hit.bary = obj_bary;
+			hit.backface = obj_backface;
+		}
+	}
+}
+
+template<FaceMode Faces>
+void CpuRenderer::traverse(const Ray& ray, Hit& hit, uint64_t& node_visits) const
+{
+	traceAnalytic<Faces>(ray, hit);
+
+	const std::vector<Bvh::Node>& nodes = bvh.getNodes();
+	const std::vector<unsigned>& indices = bvh.getIndices();
+	if (nodes.empty()) return;
+
+	glm::vec3 inv_dir = safe_inverse(ray.direction);
+	unsigned stack[BVH_STACK_SIZE];
+	int stack_size = 0;
+	stack[stack_size++] = 0;
+
+	while (stack_size > 0)
+	{
+		const Bvh::Node& node = nodes[stack[--stack_size]];
+		node_visits++;
+
+		float t_near;
+		if (!box_intersect(node.bounds_min, node.bounds_max, ray.origin, inv_dir, hit.t, t_near)) continue;
+
+		if (node.count == 0) push_children(nodes, node, ray.origin, stack, stack_size);
+		else intersectLeaf<Faces>(node, indices, ray, hit);
+	}
+}
+
+bool CpuRenderer::trace(const Ray& ray, Hit& hit, uint64_t& node_visits) const
+{
+	// transmitted rays travel inside objects and must see backfaces, all others cull them
+	if (ray.transmitted) traverse<FaceMode::Both>(ray, hit, node_visits);
+	else traverse<FaceMode::Front>(ray, hit, node_visits);
+
+	return hit.valid;
+}
+
+bool CpuRenderer::shadowAnalytic(const Ray& ray, glm::vec3& color_mult) const
+{
+	glm::vec3 hit_pos, hit_bary(0.0f), hit_normal(0.0f);
+	Material hit_mat;
+
+	color_mult = glm::vec3(1.0f);
+
+	float t_obj;
+	bool obj_backface;
+
+	if (plane_intersect<FaceMode::Back>(ground_plane, ray.origin, ray.direction, t_obj, obj_backface) && t_obj < 1.0f && t_obj > 0.0f)
+	{
+		hit_pos = ray.origin + t_obj * ray.direction;
+		getObjectProperties(0, hit_pos, hit_bary, hit_mat, hit_normal);
+		color_mult *= glm::vec3(hit_mat.diffuse) * (1.0f - hit_mat.diffuse.a);
+		if (color_sum(color_mult) < 0.01f) return false;
+	}
+
+	for (unsigned i = 0; i < spheres.size(); i++)
+	{
+		const Sphere& sphere = spheres[i];
+		if (sphere.definition.w < EPSILON) continue;
+
+		if (sphere_intersect<HitMode::Any, FaceMode::Both>(sphere, ray.origin, ray.direction, t_obj, obj_backface) && t_obj < 1.0f && t_obj > 0.0f)
+		{
+			hit_pos = ray.origin + t_obj * ray.direction;
+			getObjectProperties(i + 1, hit_pos, hit_bary, hit_mat, hit_normal);
+			color_mult *= glm::vec3(hit_mat.diffuse) * (1.0f - hit_mat.diffuse.a);
+			if (color_sum(color_mult) < 0.01f) return false;
+		}
+	}
+
+	return true;
+}
+
+bool CpuRenderer::shadowAttenuate(unsigned triangle, const Ray& ray, glm::vec3& color_mult) const
+{
+	float t_obj;
+	bool obj_backface;
+	glm::vec3 hit_bary, hit_normal;
+	Material hit_mat;
+
+	if (opaque_triangles[triangle])
+	{
+		if (triangle_intersect<FaceMode::Back, false>(triangles[triangle], ray.origin, ray.direction, t_obj, hit_bary, obj_backface) && t_obj < 1.0f && t_obj > 0.0f)
+		{
+			color_mult = glm::vec3(0.0f);
+			return false;
+		}
+		return true;
+	}
+
+	if (triangle_intersect<FaceMode::Back, true>(triangles[triangle], ray.origin, ray.direction, t_obj, hit_bary, obj_backface) && t_obj < 1.0f && t_obj > 0.0f)
+	{
+		getObjectProperties(triangle + (unsigned)spheres.size() + 1, ray.origin + t_obj * ray.direction, hit_bary, hit_mat, hit_normal);
+		color_mult *= glm::vec3(hit_mat.diffuse) * (1.0f - hit_mat.diffuse.a);
+		if (color_sum(color_mult) < 0.01f) return false;
+	}
+
+	return true;
+}
+
+bool CpuRenderer::shadowTrace(const Ray& ray, glm::vec3& color_mult, Stats& stats) const
+{
+	if (!shadowAnalytic(ray, color_mult)) return false;
+
+	// every occluder along the segment attenuates the light, so all overlapping leaves are visited
+	const std::vector<Bvh::Node>& nodes = bvh.getNodes();
+	const std::vector<unsigned>& indices = bvh.getIndices();
+	if (nodes.empty()) return true;
+
+	glm::vec3 inv_dir = safe_inverse(ray.direction);
+	unsigned stack[BVH_STACK_SIZE];
+	int stack_size = 0;
+	stack[stack_size++] = 0;
+
+	while (stack_size > 0)
+	{
+		const Bvh::Node& node = nodes[stack[--stack_size]];
+		stats.shadow_node_visits++;
+
+		float t_near;
+		if (!box_intersect(node.bounds_min, node.bounds_max, ray.origin, inv_dir, 1.0f, t_near)) continue;
+
+		if (node.count == 0)
+		{
+			stack[stack_size++] = node.first;
+			stack[stack_size++] = node.first + 1;
+			continue;
+		}
+
+		for (unsigned j = node.first; j < node.first + node.count; j++)
+		{
+			if (!shadowAttenuate(indices[j], ray, color_mult)) return false;
+		}
+	}
+
+	return true;
+}
+
+void CpuRenderer::traceShadowPacket(const glm::vec3* origins, const bool* active, const glm::vec3& direction, int count, Shadow* shadows, int stride, Stats& stats) const
+{
+	Ray ray;
+	ray.direction = direction;
+	ray.transmitted = false;
+
+	// the packet's rays are parallel segments, so their union lies in a prism along the shared direction:
+	// a rectangle spanned by the origins in the plane perpendicular to it, extruded over the segment length
+	glm::vec3 axis_w = glm::normalize(direction);
+	glm::vec3 axis_u = glm::normalize(std::abs(axis_w.x) > 0.9f ? glm::cross(axis_w, glm::vec3(0.0f, 1.0f, 0.0f)) : glm::cross(axis_w, glm::vec3(1.0f, 0.0f, 0.0f)));
+	glm::vec3 axis_v = glm::cross(axis_w, axis_u);
+	glm::mat3 to_prism = glm::transpose(glm::mat3(axis_u, axis_v, axis_w));
+	glm::mat3 abs_to_prism = glm::transpose(glm::mat3(glm::abs(axis_u), glm::abs(axis_v), glm::abs(axis_w)));
+	glm::vec3 prism_min(std::numeric_limits<float>::max());
+	glm::vec3 prism_max(-std::numeric_limits<float>::max());
+	float length = glm::length(direction);
+	bool alive[PACKET_SIZE];
+	int alive_count = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		Shadow& shadow = shadows[i * stride];
+		shadow.traced = active[i];
+		alive[i] = false;
+		if (!active[i]) continue;
+
+		stats.shadow_rays++;
+		ray.origin = origins[i];
+		shadow.visible = shadowAnalytic(ray, shadow.color_mult);
+		if (!shadow.visible) continue;
+
+		alive[i] = true;
+		alive_count++;
+		glm::vec3 projected = to_prism * origins[i];
+		prism_min = glm::min(prism_min, projected);
+		prism_max = glm::max(prism_max, projected);
+	}
+	prism_max.z += length;
+
+	const std::vector<Bvh::Node>& nodes = bvh.getNodes();
+	const std::vector<unsigned>& indices = bvh.getIndices();
+	if (alive_count == 0 || nodes.empty()) return;
+
+	stats.shadow_packets++;
+
+	// shared direction: the near and far face on every axis are the same for the whole packet
+	glm::vec3 inv_dir = safe_inverse(direction);
+	glm::bvec3 negative(direction.x < 0.0f, direction.y < 0.0f, direction.z < 0.0f);
+
+	unsigned stack[BVH_STACK_SIZE];
+	int stack_size = 0;
+	stack[stack_size++] = 0;
+
+	while (stack_size > 0 && alive_count > 0)
+	{
+		const Bvh::Node& node = nodes[stack[--stack_size]];
+		stats.shadow_node_visits++;
+
+		glm::vec3 center = to_prism * (0.5f * (node.bounds_min + node.bounds_max));
+		glm::vec3 extent = abs_to_prism * (0.5f * (node.bounds_max - node.bounds_min));
+		if (glm::any(glm::lessThan(center + extent, prism_min)) || glm::any(glm::greaterThan(center - extent, prism_max))) continue;
+
+		if (node.count == 0)
+		{
+			stack[stack_size++] = node.first;
+			stack[stack_size++] = node.first + 1;
+			continue;
+		}
+
+		glm::vec3 near_face(negative.x ? node.bounds_max.x : node.bounds_min.x, negative.y ? node.bounds_max.y : node.bounds_min.y, negative.z ? node.bounds_max.z : node.bounds_min.z);
+		glm::vec3 far_face(negative.x ? node.bounds_min.x : node.bounds_max.x, negative.y ? node.bounds_min.y : node.bounds_max.y, negative.z ? node.bounds_min.z : node.bounds_max.z);
+
+		for (int i = 0; i < count; i++)
+		{
+			if (!alive[i]) continue;
+			stats.shadow_node_visits++;
+
+			glm::vec3 t_near = (near_face - origins[i]) * inv_dir;
+			glm::vec3 t_far = (far_face - origins[i]) * inv_dir;
+			if (std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.0f)) > std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, 1.0f))) continue;
+
+			Shadow& shadow = shadows[i * stride];
+			ray.origin = origins[i];
+			for (unsigned j = node.first; j < node.first + node.count; j++)
+			{
+				if (!shadowAttenuate(indices[j], ray, shadow.color_mult))
+				{
+					shadow.visible = false;
+					alive[i] = false;
+					alive_count--;
+					break;
+				}
+			}
+		}
+	}
+}
+
+bool CpuRenderer::castRay(const Ray& ray, const Hit& hit, const Surface* surface, const Shadow* shadows, glm::vec3& color, glm::vec3& hit_pos, glm::vec3& hit_normal, Material& hit_material, bool& backface, Stats& stats) const
+{
+	color = glm::vec3(0.0f);
+	backface = hit.backface;
+
+	stats.rays++;
+
+	if (hit.valid && hit.t >= 0.0f)
+	{
+		hit_pos = hit.position;
+		if (surface != nullptr)
+		{
+			hit_material = surface->material;
+			hit_normal = surface->normal;
+		}
+		else getObjectProperties(hit.object, hit_pos, hit.bary, hit_material, hit_normal);
+
+		if (ray.depth >= RECURSION_DEPTH - 1) hit_material.diffuse.a = 1.0f;
+
+		glm::vec3 view_dir = -glm::normalize(ray.direction);
+
+		Ray shadow_ray;
+		bool light_visible;
+		glm::vec3 light_color_mult, light_color;
+		float light_intensity = 0.0f, light_distance = 0.0f;
+		shadow_ray.origin = hit_pos + EPSILON * hit_normal;
+		shadow_ray.transmitted = false;
+
+		for (size_t l = 0; l < lights.size(); l++)
+		{
+			const Light& light = lights[l];
+			if (light.intensity < EPSILON) continue;
+
+			switch (light.type)
+			{
+				case 0:
+					shadow_ray.direction = light.position - shadow_ray.origin;
+
+					light_distance = glm::length(shadow_ray.direction);
+					light_intensity = light.intensity / (light_distance * light_distance);
+					if (light_intensity < 0.01f) continue;
+					break;
+				case 1:
+					shadow_ray.direction = -100.0f * light.direction;
+					light_distance = 100.0f;
+					light_intensity = light.intensity;
+					break;
+			}
+
+			if (shadows != nullptr && shadows[l].traced)
+			{
+				light_visible = shadows[l].visible;
+				light_color_mult = shadows[l].color_mult;
+			}
+			else
+			{
+				stats.shadow_rays++;
+				light_visible = shadowTrace(shadow_ray, light_color_mult, stats);
+			}
+			light_color = light.color * light_color_mult;
+
+			if (light_visible) color += phong_lighting(view_dir, hit_normal, hit_material, -shadow_ray.direction / light_distance, light_color, light_intensity);
+			else color += hit_material.ambient * light_color * light_intensity;
+		}
+
+		color += hit_material.emissive;
+
+		return true;
+	}
+
+	return false;
+}
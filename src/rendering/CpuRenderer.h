@@ -0,0 +1,146 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <rendering/Lights.h>
+#include <rendering/SceneObjects.h>
+#include <rendering/Image.h>
+#include <rendering/Bvh.h>
+#include <rendering/Kernels.h>
+
+// CPU port of Raytrace.frag, used for headless rendering on machines without a display or GPU.
+class CpuRenderer
+{
+public:
+	static const int TILE_SIZE = 8;
+
+	// Ray: every primary ray walks the BVH on its own.
+	// Packet: the primary rays of a tile are culled against the tile frustum as one packet,
+	// falling back to per-ray traversal when the packet is too divergent for the frustum to cull well.
+	enum class Traversal { Ray, Packet };
+
+	struct Stats
+	{
+		uint64_t rays;
+		uint64_t shadow_rays;
+		uint64_t primary_node_visits;
+		uint64_t secondary_node_visits;
+		uint64_t shadow_node_visits;
+		uint64_t packets;
+		uint64_t packet_fallbacks;
+		uint64_t shadow_packets;
+
+		Stats() : rays(0), shadow_rays(0), primary_node_visits(0), secondary_node_visits(0), shadow_node_visits(0), packets(0), packet_fallbacks(0), shadow_packets(0) {}
+
+		Stats& operator+=(const Stats& other);
+	};
+
+	CpuRenderer(const std::vector<Light>& lights, const std::vector<Sphere>& spheres, const std::vector<Vertex>& vertices,
+				const std::vector<Triangle>& triangles, const std::vector<Image>& textures)
+		: lights(lights), spheres(spheres), vertices(vertices), triangles(triangles), textures(textures),
+		  bvh(), opaque_triangles(), traversal(Traversal::Packet), shadow_packets(true), roulette_depth(0), ground_plane(), cam_pos(), img_origin(), img_right(), img_up()
+	{
+		updateScene();
+	}
+
+	// Rebuilds the acceleration structure; call after the scene vectors changed.
+	void updateScene();
+
+	void setTraversal(Traversal mode) { traversal = mode; }
+	// Shadow rays from a tile's primary hits towards the same directional light are traced as one packet.
+	void setShadowPackets(bool enabled) { shadow_packets = enabled; }
+	// Spawned rays from this depth on play Russian roulette, see keep_ray in RaytraceCommon.glsl; 0 for none.
+	void setRouletteDepth(int depth) { roulette_depth = depth; }
+	void setGroundPlane(const glm::vec4& plane) { ground_plane = plane; }
+	void setCamera(const glm::vec3& position, const glm::vec3& origin, const glm::vec3& right, const glm::vec3& up);
+
+	Stats render(Image& target, int samples, int threads) const { return renderRows(target, 0, target.height, samples, threads); }
+	// Renders rows first_row .. first_row + band.height - 1 of an image_height tall frame into band.
+	// first_row must be a multiple of TILE_SIZE so the tiles match those of a full-frame render.
+	Stats renderRows(Image& band, int first_row, int image_height, int samples, int threads) const;
+
+private:
+	static const int RECURSION_DEPTH = 5;
+	static const int MAX_RAYS = 31;
+	static const int PACKET_SIZE = TILE_SIZE * TILE_SIZE;
+	static const int BVH_STACK_SIZE = Bvh::MAX_STACK_SIZE;
+
+	struct Ray
+	{
+		glm::vec3 origin;
+		glm::vec3 direction;
+		glm::vec3 color_mult;
+		int depth;
+		bool transmitted;
+	};
+
+	struct Hit
+	{
+		float t;
+		glm::vec3 position;
+		unsigned object;
+		glm::vec3 bary;
+		bool backface;
+		bool valid;
+	};
+
+	// Primary hit surface, evaluated up front when shadow packets are built from it.
+	struct Surface
+	{
+		Material material;
+		glm::vec3 normal;
+	};
+
+	struct Shadow
+	{
+		glm::vec3 color_mult;
+		bool visible;
+		bool traced;
+	};
+
+	// Side planes of a tile's view frustum, all passing through the camera position.
+	struct Frustum
+	{
+		glm::vec3 origin;
+		glm::vec3 normals[4];
+
+		bool intersects(const glm::vec3& bounds_min, const glm::vec3& bounds_max) const;
+	};
+
+	const std::vector<Light>& lights;
+	const std::vector<Sphere>& spheres;
+	const std::vector<Vertex>& vertices;
+	const std::vector<Triangle>& triangles;
+	const std::vector<Image>& textures;
+
+	Bvh bvh;
+	// triangles whose vertex materials are all fully opaque block shadow rays without evaluating attributes
+	std::vector<bool> opaque_triangles;
+	Traversal traversal;
+	bool shadow_packets;
+	int roulette_depth;
+	glm::vec4 ground_plane;
+	glm::vec3 cam_pos;
+	glm::vec3 img_origin;
+	glm::vec3 img_right;
+	glm::vec3 img_up;
+
+	void renderTile(Image& band, int first_row, int image_height, int tile_x, int tile_y, int samples, Stats& stats) const;
+	glm::vec3 renderSample(const Ray& start_ray, const Hit& start_hit, const Surface* start_surface, const Shadow* start_shadows, unsigned seed, Stats& stats) const;
+	bool keepRay(glm::vec3& color_mult, int depth, const glm::vec3& position, unsigned seed) const;
+	bool makeTileFrustum(const glm::vec2& tile_min, const glm::vec2& tile_max, Frustum& frustum) const;
+	void tracePacket(const Ray* rays, Hit* hits, int count, const Frustum& frustum, Stats& stats) const;
+	void traceShadowPacket(const glm::vec3* origins, const bool* active, const glm::vec3& direction, int count, Shadow* shadows, int stride, Stats& stats) const;
+
+	glm::vec4 sampleTexture(int index, const glm::vec2& uv) const;
+	void getObjectProperties(unsigned object, const glm::vec3& position, const glm::vec3& bary, Material& mat, glm::vec3& normal) const;
+	template<FaceMode Faces> void traceAnalytic(const Ray& ray, Hit& hit) const;
+	template<FaceMode Faces> void intersectLeaf(const Bvh::Node& node, const std::vector<unsigned>& indices, const Ray& ray, Hit& hit) const;
+	template<FaceMode Faces> void traverse(const Ray& ray, Hit& hit, uint64_t& node_visits) const;
+	bool trace(const Ray& ray, Hit& hit, uint64_t& node_visits) const;
+	bool shadowAnalytic(const Ray& ray, glm::vec3& color_mult) const;
+	bool shadowAttenuate(unsigned triangle, const Ray& ray, glm::vec3& color_mult) const;
+	bool shadowTrace(const Ray& ray, glm::vec3& color_mult, Stats& stats) const;
+	bool castRay(const Ray& ray, const Hit& hit, const Surface* surface, const Shadow* shadows, glm::vec3& color, glm::vec3& hit_pos, glm::vec3& hit_normal, Material& hit_material, bool& backface, Stats& stats) const;
+};
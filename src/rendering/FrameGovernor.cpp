@@ -0,0 +1,108 @@
+#include "FrameGovernor.h"
+
+#include <algorithm>
+#include <rendering/GpuTimer.h>
+
+// from full quality down; every step makes the frame cheaper
+static const FrameGovernor::Level LEVELS[] = {
+	{ 1.0f, 5, 4 },
+	{ 1.0f, 4, 2 },
+	{ 1.0f, 3, 1 },
+	{ 0.75f, 3, 1 },
+	{ 0.75f, 2, 1 },
+	{ 0.5f, 2, 1 },
+	{ 0.5f, 1, 1 },
+	{ 0.35f, 1, 1 },
+	{ 0.25f, 1, 1 },
+};
+static const int LEVEL_COUNT = sizeof(LEVELS) / sizeof(LEVELS[0]);
+
+// steps down above SLOW_RATIO * target, up when the predicted time is below FAST_RATIO * target
+static const double SLOW_RATIO = 1.1;
+static const double FAST_RATIO = 0.85;
+// consecutive frames a threshold must be crossed for; going up is the cautious direction
+static const int SLOW_FRAMES = 3;
+static const int FAST_FRAMES = 10;
+// weight of a new frame in the smoothed time, once enough samples are averaged
+static const double SMOOTHING = 0.2;
+// samples at a new level before its time is compared with the previous one
+static const int MEASURE_SAMPLES = 4;
+// assumed time ratio of adjacent levels until a step was measured
+static const double DEFAULT_STEP_COST = 1.5;
+
+FrameGovernor::FrameGovernor(double target_ms)
+	: target_ms(target_ms), level(0), average_ms(0.0), samples(0), settle_frames(0), slow_frames(0), fast_frames(0),
+	  step_cost(LEVEL_COUNT - 1, DEFAULT_STEP_COST), previous_level(-1), previous_ms(0.0)
+{
+}
+
+const FrameGovernor::Level& FrameGovernor::getLevel() const
+{
+	return LEVELS[level];
+}
+
+bool FrameGovernor::update(double frame_ms)
+{
+	// GpuTimer reports every frame RING_SIZE frames late, those still ran at the previous level
+	if (settle_frames > 0)
+	{
+		settle_frames--;
+		return false;
+	}
+
+	samples++;
+	average_ms += std::max(SMOOTHING, 1.0 / samples) * (frame_ms - average_ms);
+
+	if (samples == MEASURE_SAMPLES && previous_level >= 0)
+	{
+		// adjacent levels only, the governor moves one step at a time
+		int upper = std::min(level, previous_level);
+		double cost = level == upper ? average_ms / previous_ms : previous_ms / average_ms;
+		step_cost[upper] = std::max(1.0, cost);
+		previous_level = -1;
+	}
+
+	if (average_ms > SLOW_RATIO * target_ms)
+	{
+		slow_frames++;
+		fast_frames = 0;
+	}
+	else if (level > 0 && average_ms * step_cost[level - 1] < FAST_RATIO * target_ms)
+	{
+		fast_frames++;
+		slow_frames = 0;
+	}
+	else
+	{
+		slow_frames = 0;
+		fast_frames = 0;
+	}
+
+	if (slow_frames >= SLOW_FRAMES && level + 1 < LEVEL_COUNT) return change(level + 1);
+	if (fast_frames >= FAST_FRAMES) return change(level - 1);
+	return false;
+}
+
+bool FrameGovernor::change(int new_level)
+{
+	previous_level = level;
+	previous_ms = average_ms;
+	level = new_level;
+
+	average_ms = 0.0;
+	samples = 0;
+	settle_frames = GpuTimer::RING_SIZE;
+	slow_frames = 0;
+	fast_frames = 0;
+	return true;
+}
+
+void FrameGovernor::report(std::ostream& out) const
+{
+	const Level& settings = LEVELS[level];
+	out << "Governor: level " << level << "/" << LEVEL_COUNT - 1 << ", render scale " << settings.render_scale << ", recursion depth "
+		<< settings.recursion_depth << ", at most " << settings.aa_samples << " edge samples; GPU trace ";
+	if (samples > 0) out << average_ms << " ms";
+	else out << "not measured yet";
+	out << ", target " << target_ms << " ms" << std::endl;
+}
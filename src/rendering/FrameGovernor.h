@@ -0,0 +1,53 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+
+// Keeps the GPU time of the tracer near a target by trading image quality. The settings form a ladder of levels
+// from full render scale, recursion depth and edge samples down to a quarter of the resolution and no secondary
+// rays. The governor steps down when the smoothed time stays above the target, and up when the time the next
+// level is predicted to take stays well below it; the prediction uses the cost of each step as measured when it
+// was last taken. The dead band between the two thresholds and a settling period after every change keep the
+// quality from oscillating.
+class FrameGovernor
+{
+public:
+	struct Level
+	{
+		// fraction of the window size traced in each dimension, scaled up when presented
+		float render_scale;
+		unsigned recursion_depth;
+		// most extra samples per edge pixel, the user's budget applies below it
+		int aa_samples;
+	};
+
+	explicit FrameGovernor(double target_ms);
+
+	// Feeds the GPU time of a traced frame; returns true when the level changed.
+	bool update(double frame_ms);
+
+	const Level& getLevel() const;
+	int getLevelIndex() const { return level; }
+	double getTarget() const { return target_ms; }
+
+	// Prints the level, its settings and the smoothed time against the target.
+	void report(std::ostream& out) const;
+
+private:
+	double target_ms;
+	int level;
+	// smoothed time at the current level and the samples it is made of
+	double average_ms;
+	int samples;
+	// frames still timed with the previous level
+	int settle_frames;
+	int slow_frames;
+	int fast_frames;
+	// time of level i over that of level i + 1
+	std::vector<double> step_cost;
+	// level and smoothed time before the last change, until the step cost is measured
+	int previous_level;
+	double previous_ms;
+
+	bool change(int new_level);
+};
@@ -0,0 +1,45 @@
+#include "FrameUniforms.h"
+
+FrameUniforms::FrameUniforms()
+	: data(), buffer(0)
+{
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(Data), &data, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, buffer);
+}
+
+FrameUniforms::~FrameUniforms()
+{
+	glDeleteBuffers(1, &buffer);
+}
+
+void FrameUniforms::setCamera(const glm::vec3& position, const glm::vec3& origin, const glm::vec3& right, const glm::vec3& up)
+{
+	data.cam_pos = glm::vec4(position, 0.0f);
+	data.img_origin = glm::vec4(origin, 0.0f);
+	data.img_right = glm::vec4(right, 0.0f);
+	data.img_up = glm::vec4(up, 0.0f);
+}
+
+void FrameUniforms::setPixelSize(const glm::vec2& size)
+{
+	data.pixel_size = size;
+}
+
+void FrameUniforms::setJitter(const glm::vec2& jitter)
+{
+	data.jitter = jitter;
+}
+
+void FrameUniforms::upload()
+{
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Data), &data);
+	data.frame_index++;
+
+	data.prev_cam_pos = data.cam_pos;
+	data.prev_img_origin = data.img_origin;
+	data.prev_img_right = data.img_right;
+	data.prev_img_up = data.img_up;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// The Frame uniform block of Frame.glsl: camera, jitter and frame index of both tracers. Setters only
+// change the CPU copy, upload() writes the whole block with one glBufferSubData.
+class FrameUniforms
+{
+public:
+	static const GLuint BINDING = 0;
+
+	// Creates the buffer and binds it to BINDING.
+	FrameUniforms();
+	~FrameUniforms();
+
+	void setCamera(const glm::vec3& position, const glm::vec3& origin, const glm::vec3& right, const glm::vec3& up);
+	void setPixelSize(const glm::vec2& size);
+	// Subpixel offset of the primary rays in pixels.
+	void setJitter(const glm::vec2& jitter);
+
+	// Uploads the block for the next frame, advances frame_index and keeps the camera as the next
+	// frame's previous one.
+	void upload();
+
+	GLuint getFrameIndex() const { return data.frame_index; }
+
+private:
+	// std140 layout of Frame
+	struct Data
+	{
+		glm::vec4 cam_pos;
+		glm::vec4 img_origin;
+		glm::vec4 img_right;
+		glm::vec4 img_up;
+		glm::vec2 pixel_size;
+		glm::vec2 jitter;
+		GLuint frame_index;
+		GLuint padding[3];
+		glm::vec4 prev_cam_pos;
+		glm::vec4 prev_img_origin;
+		glm::vec4 prev_img_right;
+		glm::vec4 prev_img_up;
+	};
+
+	Data data;
+	GLuint buffer;
+};
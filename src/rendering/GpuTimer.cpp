@@ -0,0 +1,183 @@
+#include "GpuTimer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+static const char* FRAME_SCOPE = "frame";
+
+// nearest-rank percentile of sorted samples
+static double percentile(const std::vector<double>& sorted, double p)
+{
+	size_t rank = (size_t)std::ceil(p * sorted.size());
+	return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+GpuTimer::GpuTimer()
+	: frame(0), dropped_frames(0)
+{
+	for (Slot& slot : slots)
+	{
+		slot.used_queries = 0;
+		slot.pending = false;
+	}
+}
+
+GpuTimer::~GpuTimer()
+{
+	for (Slot& slot : slots)
+	{
+		if (!slot.queries.empty()) glDeleteQueries((GLsizei)slot.queries.size(), slot.queries.data());
+	}
+}
+
+bool GpuTimer::openCsv(const std::string& path)
+{
+	csv.open(path);
+	if (!csv)
+	{
+		std::cout << "Can't open " << path << " for writing" << std::endl;
+		return false;
+	}
+	csv << "time,scope,samples,min_ms,avg_ms,max_ms,p95_ms,p99_ms" << std::endl;
+	return true;
+}
+
+int GpuTimer::scopeIndex(const std::string& scope)
+{
+	auto it = std::find(scope_names.begin(), scope_names.end(), scope);
+	if (it != scope_names.end()) return (int)(it - scope_names.begin());
+
+	scope_names.push_back(scope);
+	samples.push_back(std::vector<double>());
+	latest.push_back(-1.0);
+	return (int)scope_names.size() - 1;
+}
+
+int GpuTimer::timestamp()
+{
+	Slot& slot = slots[frame % RING_SIZE];
+	if (slot.used_queries == (int)slot.queries.size())
+	{
+		GLuint query;
+		glGenQueries(1, &query);
+		slot.queries.push_back(query);
+	}
+
+	glQueryCounter(slot.queries[slot.used_queries], GL_TIMESTAMP);
+	return slot.used_queries++;
+}
+
+void GpuTimer::collect(Slot& slot)
+{
+	slot.pending = false;
+	if (slot.records.empty()) return;
+
+	// queries complete in order, so the last one being available means all are
+	GLuint available = GL_FALSE;
+	glGetQueryObjectuiv(slot.queries[slot.used_queries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+	{
+		dropped_frames++;
+		return;
+	}
+
+	for (const Record& record : slot.records)
+	{
+		GLuint64 start, finish;
+		glGetQueryObjectui64v(slot.queries[record.begin_query], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(slot.queries[record.end_query], GL_QUERY_RESULT, &finish);
+		samples[record.scope].push_back((finish - start) * 1e-6);
+		latest[record.scope] = samples[record.scope].back();
+	}
+}
+
+void GpuTimer::beginFrame()
+{
+	Slot& slot = slots[frame % RING_SIZE];
+	if (slot.pending) collect(slot);
+
+	slot.records.clear();
+	slot.used_queries = 0;
+	open_records.clear();
+
+	begin(FRAME_SCOPE);
+}
+
+void GpuTimer::endFrame()
+{
+	while (!open_records.empty()) end();
+
+	slots[frame % RING_SIZE].pending = true;
+	frame++;
+}
+
+void GpuTimer::begin(const std::string& scope)
+{
+	Slot& slot = slots[frame % RING_SIZE];
+
+	Record record;
+	record.scope = scopeIndex(scope);
+	record.begin_query = timestamp();
+	record.end_query = -1;
+
+	open_records.push_back((int)slot.records.size());
+	slot.records.push_back(record);
+}
+
+void GpuTimer::end()
+{
+	if (open_records.empty()) return;
+
+	Slot& slot = slots[frame % RING_SIZE];
+	slot.records[open_records.back()].end_query = timestamp();
+	open_records.pop_back();
+}
+
+bool GpuTimer::takeLatest(const std::string& scope, double& milliseconds)
+{
+	auto it = std::find(scope_names.begin(), scope_names.end(), scope);
+	if (it == scope_names.end()) return false;
+
+	double& sample = latest[it - scope_names.begin()];
+	if (sample < 0.0) return false;
+
+	milliseconds = sample;
+	sample = -1.0;
+	return true;
+}
+
+void GpuTimer::report(std::ostream& out, double time)
+{
+	for (size_t i = 0; i < scope_names.size(); i++)
+	{
+		std::vector<double>& scope_samples = samples[i];
+		if (scope_samples.empty()) continue;
+
+		std::sort(scope_samples.begin(), scope_samples.end());
+		double sum = 0.0;
+		for (double sample : scope_samples) sum += sample;
+
+		double min = scope_samples.front();
+		double max = scope_samples.back();
+		double avg = sum / scope_samples.size();
+		double p95 = percentile(scope_samples, 0.95);
+		double p99 = percentile(scope_samples, 0.99);
+
+		out << "  GPU " << scope_names[i] << ": min/avg/max " << min << "/" << avg << "/" << max << " ms, p95 " << p95 << " ms, p99 " << p99
+			<< " ms (" << scope_samples.size() << " frames)" << std::endl;
+		if (csv.is_open())
+		{
+			csv << time << "," << scope_names[i] << "," << scope_samples.size() << "," << min << "," << avg << "," << max << "," << p95 << "," << p99 << "\n";
+		}
+
+		scope_samples.clear();
+	}
+
+	if (dropped_frames > 0)
+	{
+		out << "  GPU timings of " << dropped_frames << " frames dropped, results were not ready in time" << std::endl;
+		dropped_frames = 0;
+	}
+	if (csv.is_open()) csv.flush();
+}
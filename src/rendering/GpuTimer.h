@@ -0,0 +1,67 @@
+#pragma once
+
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+
+// GPU time of named scopes, measured with GL_TIMESTAMP queries. Every frame writes its queries into the
+// next slot of a ring and reads back the slot's results from RING_SIZE frames earlier, so the CPU never
+// waits for the GPU; a frame whose results are still not available is dropped instead.
+// Scopes may nest: the frame itself is the outermost scope.
+class GpuTimer
+{
+public:
+	static const int RING_SIZE = 4;
+
+	GpuTimer();
+	~GpuTimer();
+
+	// Appends every report as rows of time, scope, samples, min, avg, max, p95 and p99 (in ms) to path.
+	bool openCsv(const std::string& path);
+
+	void beginFrame();
+	void endFrame();
+
+	void begin(const std::string& scope);
+	void end();
+
+	// Prints min/avg/max/p95/p99 of every scope measured since the last report, writes them to the CSV
+	// file and starts over.
+	void report(std::ostream& out, double time);
+
+	// The newest time of a scope in milliseconds, RING_SIZE frames old; false if none arrived since the last call.
+	bool takeLatest(const std::string& scope, double& milliseconds);
+
+private:
+	struct Record
+	{
+		int scope;
+		int begin_query;
+		int end_query;
+	};
+
+	struct Slot
+	{
+		std::vector<GLuint> queries;
+		std::vector<Record> records;
+		int used_queries;
+		bool pending;
+	};
+
+	std::vector<std::string> scope_names;
+	// samples in milliseconds per scope since the last report
+	std::vector<std::vector<double>> samples;
+	// newest sample per scope, negative once taken
+	std::vector<double> latest;
+	Slot slots[RING_SIZE];
+	int frame;
+	int dropped_frames;
+	std::vector<int> open_records;
+	std::ofstream csv;
+
+	int scopeIndex(const std::string& scope);
+	int timestamp();
+	void collect(Slot& slot);
+};
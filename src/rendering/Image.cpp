@@ -0,0 +1,252 @@
+#include "Image.h"
+
+#include <stb_image.h>
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <helpers/RootDir.h>
+
+bool Image::load(const std::string& filename)
+{
+	int components;
+	unsigned char* data = stbi_load((ROOT_DIR + filename).c_str(), &width, &height, &components, 4);
+	if (data == nullptr)
+	{
+		std::cout << "Could not load file " << filename << std::endl;
+		width = height = 0;
+		pixels.clear();
+		return false;
+	}
+
+	pixels.resize((size_t)width * height);
+	for (size_t i = 0; i < pixels.size(); i++)
+	{
+		pixels[i] = glm::vec4(data[4 * i], data[4 * i + 1], data[4 * i + 2], data[4 * i + 3]) / 255.0f;
+	}
+
+	stbi_image_free(data);
+	return true;
+}
+
+bool Image::save(const std::string& filename) const
+{
+	ImageWriter::Format format;
+	if (!ImageWriter::formatFromFilename(filename, format))
+	{
+		std::cout << "Unsupported image format: " << filename << std::endl;
+		return false;
+	}
+
+	return format == ImageWriter::Format::PFM ? savePFM(filename) : savePNG(filename);
+}
+
+glm::vec4 Image::sample(const glm::vec2& uv) const
+{
+	if (width == 0 || height == 0) return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+	// bilinear filtering with GL_REPEAT wrapping
+	glm::vec2 texel = uv * glm::vec2(width, height) - 0.5f;
+	glm::vec2 base = glm::floor(texel);
+	glm::vec2 frac = texel - base;
+
+	int x0 = (int)base.x % width;
+	int y0 = (int)base.y % height;
+	if (x0 < 0) x0 += width;
+	if (y0 < 0) y0 += height;
+	int x1 = (x0 + 1) % width;
+	int y1 = (y0 + 1) % height;
+
+	glm::vec4 bottom = glm::mix(at(x0, y0), at(x1, y0), frac.x);
+	glm::vec4 top = glm::mix(at(x0, y1), at(x1, y1), frac.x);
+	return glm::mix(bottom, top, frac.y);
+}
+
+static uint32_t crc32(uint32_t crc, const unsigned char* data, size_t length)
+{
+	static uint32_t table[256] = { 0 };
+	if (table[1] == 0)
+	{
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			table[i] = c;
+		}
+	}
+
+	crc = ~crc;
+	for (size_t i = 0; i < length; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void put_u32(std::vector<unsigned char>& out, uint32_t value)
+{
+	out.push_back((value >> 24) & 0xFF);
+	out.push_back((value >> 16) & 0xFF);
+	out.push_back((value >> 8) & 0xFF);
+	out.push_back(value & 0xFF);
+}
+
+bool Image::savePNG(const std::string& filename) const
+{
+	ImageWriter writer;
+	return writer.open(filename, ImageWriter::Format::PNG, width, height) && writer.writeRows(*this) && writer.close();
+}
+
+bool Image::savePFM(const std::string& filename) const
+{
+	ImageWriter writer;
+	return writer.open(filename, ImageWriter::Format::PFM, width, height) && writer.writeRows(*this) && writer.close();
+}
+
+bool ImageWriter::formatFromFilename(const std::string& filename, Format& format)
+{
+	auto dot = filename.find_last_of('.');
+	std::string extension = dot == std::string::npos ? "" : filename.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+	if (extension == "pfm") format = Format::PFM;
+	else if (extension == "png") format = Format::PNG;
+	else return false;
+	return true;
+}
+
+bool ImageWriter::open(const std::string& filename, Format format, int width, int height)
+{
+	file.open(filename, std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cout << "Could not open file " << filename << std::endl;
+		return false;
+	}
+
+	this->format = format;
+	this->width = width;
+	this->height = height;
+	rows_written = 0;
+	bytes_written = 0;
+	adler_a = 1;
+	adler_b = 0;
+
+	if (format == Format::PFM)
+	{
+		// PFM stores rows bottom to top, which matches our row order; negative scale means little endian
+		std::string header = "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n";
+		file.write(header.data(), header.size());
+		bytes_written += header.size();
+	}
+	else
+	{
+		const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		file.write(reinterpret_cast<const char*>(signature), 8);
+		bytes_written += 8;
+
+		std::vector<unsigned char> header;
+		put_u32(header, width);
+		put_u32(header, height);
+		header.insert(header.end(), { 8 /* bit depth */, 2 /* RGB */, 0, 0, 0 });
+		writeChunk("IHDR", header);
+	}
+
+	return file.good();
+}
+
+bool ImageWriter::writeRows(const Image& rows)
+{
+	if (!file.is_open() || rows.width != width || rows_written + rows.height > height)
+	{
+		std::cout << "Image rows do not fit the output file" << std::endl;
+		return false;
+	}
+
+	if (format == Format::PFM)
+	{
+		std::vector<float> row(3 * (size_t)width);
+		for (int y = 0; y < rows.height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				const glm::vec4& p = rows.at(x, y);
+				row[3 * x] = p.r;
+				row[3 * x + 1] = p.g;
+				row[3 * x + 2] = p.b;
+			}
+			file.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(float));
+		}
+		bytes_written += (uint64_t)rows.height * width * 3 * sizeof(float);
+		rows_written += rows.height;
+		return file.good();
+	}
+
+	// scanlines with filter type 0, top row first, clamped to [0, 1] like the default framebuffer
+	std::vector<unsigned char> raw;
+	raw.reserve((size_t)rows.height * (3 * width + 1));
+	for (int y = rows.height - 1; y >= 0; y--)
+	{
+		raw.push_back(0);
+		for (int x = 0; x < width; x++)
+		{
+			glm::vec3 c = glm::clamp(glm::vec3(rows.at(x, y)), 0.0f, 1.0f);
+			raw.push_back((unsigned char)(c.r * 255.0f + 0.5f));
+			raw.push_back((unsigned char)(c.g * 255.0f + 0.5f));
+			raw.push_back((unsigned char)(c.b * 255.0f + 0.5f));
+		}
+	}
+
+	// every call adds one IDAT chunk of uncompressed deflate blocks to a single zlib stream,
+	// which is opened by the first chunk and closed (final block and checksum) by the last one
+	bool first = rows_written == 0;
+	rows_written += rows.height;
+	bool last = rows_written == height;
+
+	std::vector<unsigned char> zlib;
+	zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+	if (first) zlib.insert(zlib.end(), { 0x78, 0x01 });
+	size_t offset = 0;
+	do
+	{
+		size_t length = std::min<size_t>(raw.size() - offset, 65535);
+		bool final_block = last && offset + length == raw.size();
+		zlib.push_back(final_block ? 1 : 0);
+		zlib.push_back(length & 0xFF);
+		zlib.push_back((length >> 8) & 0xFF);
+		zlib.push_back(~length & 0xFF);
+		zlib.push_back((~length >> 8) & 0xFF);
+		for (size_t i = offset; i < offset + length; i++)
+		{
+			adler_a = (adler_a + raw[i]) % 65521;
+			adler_b = (adler_b + adler_a) % 65521;
+		}
+		zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+		offset += length;
+	} while (offset < raw.size());
+	if (last) put_u32(zlib, (adler_b << 16) | adler_a);
+
+	writeChunk("IDAT", zlib);
+	return file.good();
+}
+
+bool ImageWriter::close()
+{
+	if (!file.is_open()) return false;
+
+	bool complete = rows_written == height;
+	if (!complete) std::cout << "Image closed after " << rows_written << " of " << height << " rows" << std::endl;
+	if (format == Format::PNG) writeChunk("IEND", {});
+
+	bool good = file.good();
+	file.close();
+	return complete && good;
+}
+
+void ImageWriter::writeChunk(const char* type, const std::vector<unsigned char>& data)
+{
+	std::vector<unsigned char> chunk;
+	put_u32(chunk, (uint32_t)data.size());
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	put_u32(chunk, crc32(0, chunk.data() + 4, chunk.size() - 4));
+	file.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+	bytes_written += chunk.size();
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// CPU-side float RGBA image, used as texture source and render target for the CPU tracer.
+// Rows are stored in OpenGL order: row 0 corresponds to t = 0 (the bottom of a framebuffer).
+class Image
+{
+public:
+	Image() : width(0), height(0), pixels() {}
+	Image(int width, int height) : width(width), height(height), pixels((size_t)width * height, glm::vec4(0.0f)) {}
+
+	bool load(const std::string& filename);
+	bool save(const std::string& filename) const;
+	bool savePNG(const std::string& filename) const;
+	bool savePFM(const std::string& filename) const;
+
+	glm::vec4 sample(const glm::vec2& uv) const;
+
+	glm::vec4& at(int x, int y) { return pixels[(size_t)y * width + x]; }
+	const glm::vec4& at(int x, int y) const { return pixels[(size_t)y * width + x]; }
+
+	int width;
+	int height;
+	std::vector<glm::vec4> pixels;
+};
+
+// Writes an image as a sequence of row bands, so large renders never need the whole image in memory.
+// PNG is stored top row first, PFM bottom row first: bands have to be passed in that order
+// (see topDown()), each band being an Image of full width in the usual row order.
+class ImageWriter
+{
+public:
+	enum class Format { PNG, PFM };
+
+	ImageWriter() : file(), format(Format::PNG), width(0), height(0), rows_written(0), bytes_written(0), adler_a(1), adler_b(0) {}
+
+	static bool formatFromFilename(const std::string& filename, Format& format);
+
+	bool open(const std::string& filename, Format format, int width, int height);
+	bool writeRows(const Image& rows);
+	// Fails if fewer rows than the image height have been written.
+	bool close();
+
+	bool topDown() const { return format == Format::PNG; }
+	uint64_t getBytesWritten() const { return bytes_written; }
+
+private:
+	std::ofstream file;
+	Format format;
+	int width;
+	int height;
+	int rows_written;
+	uint64_t bytes_written;
+	uint32_t adler_a;
+	uint32_t adler_b;
+
+	void writeChunk(const char* type, const std::vector<unsigned char>& data);
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cmath>
+#include <utility>
+#include <glm/glm.hpp>
+#include <rendering/SceneObjects.h>
+
+// Intersection kernels of the CPU tracer. Hit mode and face selection are template parameters,
+// so every call site instantiates its own branch-free kernel instead of testing runtime flags
+// per primitive. Raytrace.frag mirrors the same variants through its HIT_* and FACES_* defines.
+
+// Closest: the nearest intersection in front of the origin (primary, reflected and refracted rays).
+// Any: the far intersection, used by shadow rays to find occluders between the hit and the light.
+enum class HitMode { Closest, Any };
+
+// Which sides of a surface can be hit: Front culls backfaces (opaque rays), Back only accepts
+// backfaces (shadow rays leaving a surface), Both accepts everything (transmitted rays).
+enum class FaceMode { Both, Front, Back };
+
+const float KERNEL_EPSILON = 1e-4f;
+
+template<FaceMode Faces>
+inline bool face_accepted(bool backface)
+{
+	return Faces == FaceMode::Both || (Faces == FaceMode::Front ? !backface : backface);
+}
+
+template<FaceMode Faces>
+inline bool plane_intersect(const glm::vec4& plane, const glm::vec3& origin, const glm::vec3& direction, float& t, bool& backface)
+{
+	float dn = glm::dot(direction, glm::vec3(plane));
+	backface = dn > -KERNEL_EPSILON;
+	if (!face_accepted<Faces>(backface)) return false;
+
+	float en = glm::dot(origin, glm::vec3(plane));
+	t = (plane.w - en) / dn;
+	return true;
+}
+
+template<HitMode Mode, FaceMode Faces>
+inline bool sphere_intersect(const Sphere& sphere, const glm::vec3& origin, const glm::vec3& direction, float& t, bool& backface)
+{
+	float t0, t1;
+	glm::vec3 L = origin - glm::vec3(sphere.definition);
+
+	float c = (-sphere.definition.w * sphere.definition.w) + glm::dot(L, L);
+	backface = c < 0.0f;
+	if (!face_accepted<Faces>(backface)) return false;
+
+	float cosangle = glm::dot(direction, -L);
+
+	if (!backface)
+	{
+		float limit = (sphere.definition.w / -3.0f) + glm::length(L);
+		if (cosangle < limit) return false;
+	}
+
+	float a = glm::dot(direction, direction);
+	float b = -2.0f * cosangle;
+	// solve quadratic function
+	float discr = b * b - 4.0f * a * c;
+	if (discr < 0.0f)
+		return false;
+	else if (discr == 0.0f)
+	{
+		t0 = -0.5f * b / a;
+		t1 = t0;
+	}
+	else
+	{
+		float q = (b > 0) ? -0.5f * (b + std::sqrt(discr)) : -0.5f * (b - std::sqrt(discr));
+		t0 = q / a;
+		t1 = c / q;
+	}
+
+	if (t0 > t1) std::swap(t0, t1);
+
+	if (t0 < 0)
+	{
+		t0 = t1; // use t1 if t0 is negative
+		if (t0 < 0) return false; // both negative
+	}
+
+	t = Mode == HitMode::Closest ? t0 : t1;
+	return true;
+}
+
+// Moller-Trumbore test on the triangle's precomputed edges, same as Raytrace.frag. Attributes are the barycentric
+// coordinates and backface flag; occlusion-only queries skip them.
+template<FaceMode Faces, bool NeedAttributes>
+inline bool triangle_intersect(const Triangle& triangle, const glm::vec3& origin, const glm::vec3& direction, float& t, glm::vec3& hit_bary, bool& backface)
+{
+	bool is_backface = glm::dot(direction, triangle.normal) > -KERNEL_EPSILON;
+	if (!face_accepted<Faces>(is_backface)) return false;
+	if (NeedAttributes) backface = is_backface;
+
+	glm::vec3 pvec = glm::cross(direction, triangle.edge2);
+	float inv_det = 1.0f / glm::dot(triangle.edge1, pvec);
+
+	glm::vec3 tvec = origin - triangle.vertex;
+	float bary_y = glm::dot(tvec, pvec) * inv_det;
+	if (bary_y < 0.0f || bary_y > 1.0f) return false;
+
+	glm::vec3 qvec = glm::cross(tvec, triangle.edge1);
+	float bary_z = glm::dot(direction, qvec) * inv_det;
+	if (bary_z < 0.0f || bary_y + bary_z > 1.0f) return false;
+	if (NeedAttributes) hit_bary = glm::vec3(1.0f - bary_y - bary_z, bary_y, bary_z);
+
+	t = glm::dot(triangle.edge2, qvec) * inv_det;
+	return true;
+}
@@ -0,0 +1,217 @@
+#include "MipChain.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+// support of the Kaiser filter on either side of a destination texel, in destination texels, and its window shape
+static const float KAISER_RADIUS = 3.0f;
+static const float KAISER_ALPHA = 4.0f;
+// rows a worker takes at a time
+static const int ROW_BATCH = 8;
+
+// Source texels and their weights for every destination texel along one axis, wrapped like GL_REPEAT.
+struct AxisFilter
+{
+	// taps of destination texel i are first[i] .. first[i + 1] - 1
+	std::vector<int> first;
+	std::vector<int> texels;
+	std::vector<float> weights;
+};
+
+static float bessel_i0(float x)
+{
+	// power series, it converges quickly for the window's arguments
+	float sum = 1.0f;
+	float term = 1.0f;
+	for (int k = 1; k < 24; k++)
+	{
+		float factor = x / (2.0f * k);
+		term *= factor * factor;
+		sum += term;
+	}
+	return sum;
+}
+
+static float kaiser(float x)
+{
+	if (std::abs(x) >= KAISER_RADIUS) return 0.0f;
+	float sinc = x == 0.0f ? 1.0f : std::sin(glm::pi<float>() * x) / (glm::pi<float>() * x);
+	float window = x / KAISER_RADIUS;
+	return sinc * bessel_i0(KAISER_ALPHA * std::sqrt(1.0f - window * window)) / bessel_i0(KAISER_ALPHA);
+}
+
+static AxisFilter make_axis_filter(int source_size, int size, MipChain::Filter filter)
+{
+	AxisFilter axis;
+	float scale = (float)source_size / size;
+	// in source texels, where texel i covers [i, i + 1]
+	float radius = filter == MipChain::Filter::Box ? 0.5f * scale : KAISER_RADIUS * scale;
+
+	for (int i = 0; i < size; i++)
+	{
+		axis.first.push_back((int)axis.texels.size());
+		float center = (i + 0.5f) * scale;
+		float total = 0.0f;
+
+		for (int texel = (int)std::floor(center - radius); texel < (int)std::ceil(center + radius); texel++)
+		{
+			float weight;
+			if (filter == MipChain::Filter::Box) weight = std::min(texel + 1.0f, center + radius) - std::max((float)texel, center - radius);
+			else weight = kaiser((texel + 0.5f - center) / scale);
+			if (weight == 0.0f) continue;
+
+			axis.texels.push_back(((texel % source_size) + source_size) % source_size);
+			axis.weights.push_back(weight);
+			total += weight;
+		}
+
+		for (size_t tap = axis.first.back(); tap < axis.weights.size(); tap++) axis.weights[tap] /= total;
+	}
+	axis.first.push_back((int)axis.texels.size());
+	return axis;
+}
+
+// Calls work(first_row, end_row) for batches of rows 0 .. rows - 1 on up to threads workers.
+template <typename Work>
+static void for_rows(int rows, int threads, const Work& work)
+{
+	int batches = (rows + ROW_BATCH - 1) / ROW_BATCH;
+	threads = std::min(threads, batches);
+	if (threads <= 1)
+	{
+		work(0, rows);
+		return;
+	}
+
+	std::atomic<int> next_batch(0);
+	std::vector<std::thread> workers;
+	for (int i = 0; i < threads; i++)
+	{
+		workers.emplace_back([&]()
+		{
+			int batch;
+			while ((batch = next_batch++) < batches)
+			{
+				work(batch * ROW_BATCH, std::min(rows, (batch + 1) * ROW_BATCH));
+			}
+		});
+	}
+	for (std::thread& worker : workers) worker.join();
+}
+
+static float srgb_to_linear(float value)
+{
+	return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linear_to_srgb(float value)
+{
+	return value <= 0.0031308f ? 12.92f * value : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+static unsigned char to_byte(float value)
+{
+	return (unsigned char)(glm::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+static void encode(const glm::vec4& texel, MipChain::Content content, unsigned char* pixel)
+{
+	glm::vec3 rgb = glm::vec3(texel);
+	if (content == MipChain::Content::NormalMap)
+	{
+		// opposite normals can cancel out, the level then keeps the unperturbed normal
+		float length = glm::length(rgb);
+		rgb = length > 1e-6f ? 0.5f * rgb / length + 0.5f : glm::vec3(0.5f, 0.5f, 1.0f);
+	}
+	else
+	{
+		rgb = glm::vec3(linear_to_srgb(std::max(rgb.r, 0.0f)), linear_to_srgb(std::max(rgb.g, 0.0f)), linear_to_srgb(std::max(rgb.b, 0.0f)));
+	}
+
+	pixel[0] = to_byte(rgb.r);
+	pixel[1] = to_byte(rgb.g);
+	pixel[2] = to_byte(rgb.b);
+	pixel[3] = to_byte(texel.a);
+}
+
+std::vector<MipChain::Level> MipChain::build(int width, int height, const unsigned char* pixels, Content content, Filter filter, int threads)
+{
+	if (threads < 1) threads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	std::vector<Level> levels(1);
+	levels[0].width = width;
+	levels[0].height = height;
+	levels[0].pixels.assign(pixels, pixels + (size_t)width * height * 4);
+
+	// the levels are filtered in floating point, 8 bits would lose the dark tones of linear color
+	float decode[256];
+	for (int i = 0; i < 256; i++)
+	{
+		decode[i] = content == Content::Color ? srgb_to_linear(i / 255.0f) : 2.0f * i / 255.0f - 1.0f;
+	}
+
+	std::vector<glm::vec4> source((size_t)width * height);
+	for_rows(height, threads, [&](int first_row, int end_row)
+	{
+		for (size_t i = (size_t)first_row * width; i < (size_t)end_row * width; i++)
+		{
+			const unsigned char* pixel = pixels + 4 * i;
+			source[i] = glm::vec4(decode[pixel[0]], decode[pixel[1]], decode[pixel[2]], pixel[3] / 255.0f);
+		}
+	});
+
+	while (width > 1 || height > 1)
+	{
+		int level_width = std::max(1, width / 2);
+		int level_height = std::max(1, height / 2);
+		AxisFilter horizontal = make_axis_filter(width, level_width, filter);
+		AxisFilter vertical = make_axis_filter(height, level_height, filter);
+
+		// separable: the rows are narrowed first, then the columns shortened
+		std::vector<glm::vec4> narrowed((size_t)level_width * height);
+		for_rows(height, threads, [&](int first_row, int end_row)
+		{
+			for (int y = first_row; y < end_row; y++)
+			{
+				const glm::vec4* row = &source[(size_t)y * width];
+				for (int x = 0; x < level_width; x++)
+				{
+					glm::vec4 sum(0.0f);
+					for (int tap = horizontal.first[x]; tap < horizontal.first[x + 1]; tap++) sum += horizontal.weights[tap] * row[horizontal.texels[tap]];
+					narrowed[(size_t)y * level_width + x] = sum;
+				}
+			}
+		});
+
+		Level level;
+		level.width = level_width;
+		level.height = level_height;
+		level.pixels.resize((size_t)level_width * level_height * 4);
+		std::vector<glm::vec4> filtered((size_t)level_width * level_height, glm::vec4(0.0f));
+		for_rows(level_height, threads, [&](int first_row, int end_row)
+		{
+			for (int y = first_row; y < end_row; y++)
+			{
+				glm::vec4* row = &filtered[(size_t)y * level_width];
+				for (int tap = vertical.first[y]; tap < vertical.first[y + 1]; tap++)
+				{
+					const glm::vec4* source_row = &narrowed[(size_t)vertical.texels[tap] * level_width];
+					for (int x = 0; x < level_width; x++) row[x] += vertical.weights[tap] * source_row[x];
+				}
+				for (int x = 0; x < level_width; x++) encode(row[x], content, &level.pixels[4 * ((size_t)y * level_width + x)]);
+			}
+		});
+
+		// the next level is filtered from the unclamped, unnormalized values so that no precision is lost
+		levels.push_back(std::move(level));
+		source.swap(filtered);
+		width = level_width;
+		height = level_height;
+	}
+
+	return levels;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+
+// CPU generator of complete mip chains for 8-bit RGBA textures, down to 1x1. Every level is filtered from the one
+// above it in linear space: color is decoded from sRGB first and encoded again, so that averaged texels keep their
+// brightness, and normal maps are filtered as vectors and renormalized. The rows of each level are split between
+// worker threads.
+class MipChain
+{
+public:
+	enum class Filter
+	{
+		// averages the source texels a destination texel covers
+		Box,
+		// Kaiser-windowed sinc, sharper minification at the cost of some ringing
+		Kaiser
+	};
+
+	enum class Content { Color, NormalMap };
+
+	struct Level
+	{
+		int width;
+		int height;
+		// 4 bytes per texel, in the row order of the source
+		std::vector<unsigned char> pixels;
+	};
+
+	// Returns the base level, a copy of the pixels, followed by every smaller one; threads 0 uses all cores.
+	static std::vector<Level> build(int width, int height, const unsigned char* pixels, Content content, Filter filter, int threads = 0);
+};
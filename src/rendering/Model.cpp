@@ -161,9 +161,6 @@ void Model::compile(std::vector<Vertex>& vertices, std::vector<Triangle>& triang
 			if (allowReuse) triangleReuseIndices[key3] = indices.z;
 		}
 
-		glm::vec3 center = (pos1 + pos2 + pos3) / 3.0f;
-		float radius = std::max(glm::length(pos1 - center), std::max(glm::length(pos2 - center), glm::length(pos3 - center)));
-
-		triangles.push_back(Triangle(indices, tri_normal, uvtrans, glm::vec4(center, radius)));
+		triangles.push_back(Triangle(indices, tri_normal, uvtrans, pos1, pos2, pos3));
 	}
 }
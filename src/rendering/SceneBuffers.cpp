@@ -0,0 +1,155 @@
+#include "SceneBuffers.h"
+
+#include <algorithm>
+#include <cstring>
+
+static const size_t MIN_CAPACITY = 16;
+static const GLuint64 WAIT_TIMEOUT_NS = 1000000000;
+
+SceneBuffers::SceneBuffers()
+	: empty_buffer(0), frame_fence(0), persistent(GLAD_GL_VERSION_4_4 != 0)
+{
+	for (Storage& storage : buffers)
+	{
+		storage.id = 0;
+		storage.element_size = 0;
+		storage.count = 0;
+		storage.capacity = 0;
+		storage.mapped = nullptr;
+	}
+
+	glGenBuffers(1, &empty_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, empty_buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, 0, nullptr, GL_STATIC_DRAW);
+}
+
+SceneBuffers::~SceneBuffers()
+{
+	if (frame_fence != 0) glDeleteSync(frame_fence);
+	for (Storage& storage : buffers)
+	{
+		if (storage.id != 0) glDeleteBuffers(1, &storage.id);
+	}
+	glDeleteBuffers(1, &empty_buffer);
+}
+
+void SceneBuffers::allocate(Storage& storage, size_t capacity)
+{
+	// immutable storage cannot be resized, so growing means a new buffer; the old one is released
+	// once the GPU no longer uses it
+	if (storage.id != 0) glDeleteBuffers(1, &storage.id);
+
+	glGenBuffers(1, &storage.id);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, storage.id);
+	GLsizeiptr size = capacity * storage.element_size;
+
+	if (persistent)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+		storage.mapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags | GL_MAP_FLUSH_EXPLICIT_BIT);
+	}
+	else
+	{
+		glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+	}
+
+	storage.capacity = capacity;
+}
+
+void SceneBuffers::write(Buffer buffer, const void* items, size_t element_size, size_t item_count, size_t first, size_t count)
+{
+	Storage& storage = buffers[buffer];
+	const char* source = (const char*)items;
+
+	// the mapped memory may still be read by the last frame
+	if (persistent) waitForGpu();
+
+	bool rebind = storage.count != item_count;
+	if (storage.element_size != element_size || item_count > storage.capacity)
+	{
+		rebind = true;
+		storage.element_size = element_size;
+		allocate(storage, std::max(MIN_CAPACITY, std::max(item_count, 2 * storage.capacity)));
+		// the new storage holds nothing yet
+		first = 0;
+		count = item_count;
+		storage.dirty.clear();
+	}
+
+	count = std::min(count, item_count - std::min(first, item_count));
+	if (count > 0)
+	{
+		size_t offset = first * element_size;
+		size_t size = count * element_size;
+
+		if (persistent)
+		{
+			memcpy(storage.mapped + offset, source + offset, size);
+
+			// merge with the previous range when they touch, edits tend to be sequential
+			if (!storage.dirty.empty() && storage.dirty.back().first + storage.dirty.back().second >= first && storage.dirty.back().first <= first + count)
+			{
+				std::pair<size_t, size_t>& last = storage.dirty.back();
+				size_t end = std::max(last.first + last.second, first + count);
+				last.first = std::min(last.first, first);
+				last.second = end - last.first;
+			}
+			else storage.dirty.push_back(std::make_pair(first, count));
+		}
+		else
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, storage.id);
+			glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, source + offset);
+		}
+	}
+
+	storage.count = item_count;
+	if (rebind) bind(buffer);
+}
+
+void SceneBuffers::bind(Buffer buffer)
+{
+	const Storage& storage = buffers[buffer];
+
+	// an unsized array takes its length from the bound range, which must not include the spare capacity
+	if (storage.count == 0) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, buffer, empty_buffer);
+	else glBindBufferRange(GL_SHADER_STORAGE_BUFFER, buffer, storage.id, 0, storage.count * storage.element_size);
+}
+
+void SceneBuffers::flush()
+{
+	if (!persistent) return;
+
+	for (Storage& storage : buffers)
+	{
+		if (storage.dirty.empty()) continue;
+
+		glBindBuffer(GL_COPY_WRITE_BUFFER, storage.id);
+		for (const std::pair<size_t, size_t>& range : storage.dirty)
+		{
+			glFlushMappedBufferRange(GL_COPY_WRITE_BUFFER, range.first * storage.element_size, range.second * storage.element_size);
+		}
+		storage.dirty.clear();
+	}
+}
+
+void SceneBuffers::fence()
+{
+	if (!persistent) return;
+
+	if (frame_fence != 0) glDeleteSync(frame_fence);
+	frame_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void SceneBuffers::waitForGpu()
+{
+	if (frame_fence == 0) return;
+
+	GLenum result;
+	do result = glClientWaitSync(frame_fence, GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_TIMEOUT_NS);
+	while (result == GL_TIMEOUT_EXPIRED);
+
+	glDeleteSync(frame_fence);
+	frame_fence = 0;
+}
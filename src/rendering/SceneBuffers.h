@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <glad/glad.h>
+
+// Shader storage buffers of the scene (bindings 0 - 3). With GL 4.4 their storage is immutable and stays
+// mapped, edits are written straight into it and only the dirty element ranges are flushed before the next
+// frame; the capacity grows by doubling. Without GL 4.4 the same ranges are uploaded with glBufferSubData.
+class SceneBuffers
+{
+public:
+	// in binding order of RaytraceCommon.glsl
+	enum Buffer { LIGHTS, SPHERES, VERTICES, TRIANGLES, BUFFER_COUNT };
+
+	SceneBuffers();
+	~SceneBuffers();
+
+	// Replaces the whole contents of a buffer, e.g. after the scene was regenerated.
+	template<typename T>
+	void assign(Buffer buffer, const std::vector<T>& items) { write(buffer, items.data(), sizeof(T), items.size(), 0, items.size()); }
+
+	// Writes items[first] .. items[first + count - 1] after they were edited in place.
+	template<typename T>
+	void update(Buffer buffer, const std::vector<T>& items, size_t first, size_t count) { write(buffer, items.data(), sizeof(T), items.size(), first, count); }
+
+	// Makes the writes since the last frame visible to the GPU; call before the frame's first draw.
+	void flush();
+
+	// Marks the end of a frame's draws; later writes wait until the GPU is done with them.
+	void fence();
+
+	bool isPersistent() const { return persistent; }
+
+private:
+	struct Storage
+	{
+		GLuint id;
+		size_t element_size;
+		size_t count;
+		size_t capacity;
+		char* mapped;
+		// element ranges written since the last flush, as (first, count)
+		std::vector<std::pair<size_t, size_t>> dirty;
+	};
+
+	Storage buffers[BUFFER_COUNT];
+	// bound in place of empty buffers, so their arrays have length 0 in the shaders
+	GLuint empty_buffer;
+	GLsync frame_fence;
+	bool persistent;
+
+	void write(Buffer buffer, const void* items, size_t element_size, size_t item_count, size_t first, size_t count);
+	void allocate(Storage& storage, size_t capacity);
+	void bind(Buffer buffer);
+	void waitForGpu();
+};
@@ -46,8 +46,12 @@ struct alignas(16) Triangle
 	alignas(16) glm::uvec3 indices;
 	alignas(16) glm::vec3 normal;
 	alignas(16) glm::mat2 uvtrans;
-	alignas(16) glm::vec4 enc_sphere;
-
-	Triangle() : indices(), normal(), uvtrans(), enc_sphere() {}
-	Triangle(glm::uvec3 indices, glm::vec3 normal, glm::mat2 uvtrans, glm::vec4 enc_sphere) : indices(indices), normal(normal), uvtrans(uvtrans), enc_sphere(enc_sphere) {}
+	// first vertex position and the edges to the other two, so intersection tests do not read the vertices
+	alignas(16) glm::vec3 vertex;
+	alignas(16) glm::vec3 edge1;
+	alignas(16) glm::vec3 edge2;
+
+	Triangle() : indices(), normal(), uvtrans(), vertex(), edge1(), edge2() {}
+	Triangle(glm::uvec3 indices, glm::vec3 normal, glm::mat2 uvtrans, glm::vec3 pos1, glm::vec3 pos2, glm::vec3 pos3)
+		: indices(indices), normal(normal), uvtrans(uvtrans), vertex(pos1), edge1(pos2 - pos1), edge2(pos3 - pos1) {}
 };
\ No newline at end of file
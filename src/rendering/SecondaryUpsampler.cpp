@@ -0,0 +1,84 @@
+#include "SecondaryUpsampler.h"
+
+#include <algorithm>
+#include <rendering/AdaptiveSampler.h>
+
+// after the upscaler
+static const int FIRST_UNIT = 33;
+static const char* INPUTS[3] = { "secondary_radiance", "secondary_geometry", "secondary_object" };
+// the outputs of Raytrace.frag's edge base pass
+static const GLenum FORMATS[3] = { GL_RGBA16F, GL_RGBA32F, GL_R32UI };
+
+SecondaryUpsampler::SecondaryUpsampler()
+	: fbo(0), render_width(0), render_height(0), width(0), height(0)
+{
+	std::fill(textures, textures + 3, 0);
+	glGenFramebuffers(1, &fbo);
+}
+
+SecondaryUpsampler::~SecondaryUpsampler()
+{
+	glDeleteFramebuffers(1, &fbo);
+	if (textures[0] != 0) glDeleteTextures(3, textures);
+}
+
+void SecondaryUpsampler::setUniforms(Shader& tracer)
+{
+	for (int i = 0; i < 3; i++) tracer.setUniform1i(INPUTS[i], FIRST_UNIT + i);
+	tracer_sampling = tracer.getUniform<int>("sampling");
+	tracer_downscale = tracer.getUniform<int>("secondary_downscale");
+}
+
+void SecondaryUpsampler::createTargets()
+{
+	if (textures[0] != 0) glDeleteTextures(3, textures);
+	glGenTextures(3, textures);
+
+	// on our own unit, the scene textures are bound already
+	glActiveTexture(GL_TEXTURE0 + FIRST_UNIT);
+	for (int i = 0; i < 3; i++)
+	{
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+		glTexStorage2D(GL_TEXTURE_2D, 1, FORMATS[i], width, height);
+		// integer textures are incomplete with linear filtering
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	const GLenum draw_buffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+	for (int i = 0; i < 3; i++) glFramebufferTexture2D(GL_FRAMEBUFFER, draw_buffers[i], GL_TEXTURE_2D, textures[i], 0);
+	glDrawBuffers(3, draw_buffers);
+}
+
+void SecondaryUpsampler::bind(Shader& tracer, int render_width, int render_height, int downscale)
+{
+	this->render_width = render_width;
+	this->render_height = render_height;
+
+	// every render pixel has a reduced pixel, the last ones reach past the image
+	int width = (render_width + downscale - 1) / downscale;
+	int height = (render_height + downscale - 1) / downscale;
+	if (width != this->width || height != this->height)
+	{
+		this->width = width;
+		this->height = height;
+		createTargets();
+	}
+
+	glDisable(GL_BLEND);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glViewport(0, 0, width, height);
+	tracer.set(tracer_sampling, SAMPLING_SECONDARY);
+	tracer.set(tracer_downscale, downscale);
+}
+
+void SecondaryUpsampler::bindResults()
+{
+	for (int i = 0; i < 3; i++)
+	{
+		glActiveTexture(GL_TEXTURE0 + FIRST_UNIT + i);
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+	}
+	glViewport(0, 0, render_width, render_height);
+}
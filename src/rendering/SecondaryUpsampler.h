@@ -0,0 +1,42 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <rendering/Shader.h>
+
+// Reflection and refraction rays of the fragment tracer at a reduced resolution. A secondary pass of a tracer
+// variant compiled with LOW_RES_SECONDARY traces the whole ray tree through the center of every pixel of a target
+// 1/2 or 1/4 of the render size, and writes the radiance of all rays after the primary one with the primary hit.
+// The full-size passes then only shade their primary hit and take the secondary radiance from the four nearest
+// reduced pixels, weighted by how well their primary hits match in depth and normal; a sample that none of them
+// matches, at a silhouette or on a thin object, traces its own secondary rays.
+class SecondaryUpsampler
+{
+public:
+	SecondaryUpsampler();
+	~SecondaryUpsampler();
+
+	// Assigns the secondary inputs of a tracer variant compiled with LOW_RES_SECONDARY to their texture units.
+	// The passes below must be given the tracer of the last call.
+	void setUniforms(Shader& tracer);
+
+	// Binds the reduced targets for a render of the given size (resized if it or the downscale changed), sets the
+	// viewport to them and selects the secondary pass in the tracer.
+	void bind(Shader& tracer, int render_width, int render_height, int downscale);
+
+	// Binds the results of the secondary pass as inputs of the full-size passes and restores the viewport of
+	// the render size.
+	void bindResults();
+
+private:
+	Shader::Uniform<int> tracer_sampling;
+	Shader::Uniform<int> tracer_downscale;
+	GLuint fbo;
+	// secondary radiance, primary hit normal and distance, primary hit object class
+	GLuint textures[3];
+	int render_width;
+	int render_height;
+	int width;
+	int height;
+
+	void createTargets();
+};
@@ -1,30 +1,72 @@
 #include "Shader.h"
 
 #include <glm\gtc\type_ptr.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <fstream>
+#include <iterator>
 #include <string>
+#include <helpers/GLExtensions.h>
 #include <helpers/RootDir.h>
 
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+std::string Shader::binaryCacheDirectory = ROOT_DIR "shader_cache/";
+Shader::BuildStats Shader::buildStats = { 0, 0, 0.0 };
+bool Shader::parallelCompile = false;
+
+// FNV-1a, only used to name cache files
+static void hash_append(uint64_t & hash, const std::string & text)
+{
+    for (unsigned char c : text)
+    {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    hash ^= 0xff;
+    hash *= 1099511628211ull;
+}
+
+static void make_directory(const std::string & path)
+{
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
 Shader::Shader(const std::string & vertexShaderFilename,
                const std::string & fragmentShaderFilename,
                const std::string & geometryShaderFilename, 
                const std::string & tessellationControlShaderFilename, 
                const std::string & tessellationEvaluationShaderFilename) 
                : program_id(0), 
-                 isLinked(false)
+                 isLinked(false),
+                 parallel(false),
+                 pending(false)
 {
-    const std::string shaderCodes[5] = { loadFile(vertexShaderFilename), 
-                                         loadFile(fragmentShaderFilename), 
-                                         loadFile(geometryShaderFilename),
-                                         loadFile(tessellationControlShaderFilename),
-                                         loadFile(tessellationEvaluationShaderFilename) };
-
     const std::string filenames[5] = { vertexShaderFilename, 
                                        fragmentShaderFilename, 
                                        geometryShaderFilename,
                                        tessellationControlShaderFilename,
                                        tessellationEvaluationShaderFilename };
 
+    const GLuint shaderTypes[5] = { GL_VERTEX_SHADER,
+                                    GL_FRAGMENT_SHADER,
+                                    GL_GEOMETRY_SHADER,
+                                    GL_TESS_CONTROL_SHADER,
+                                    GL_TESS_EVALUATION_SHADER };
+
     program_id = glCreateProgram();
 
     if (program_id == 0)
@@ -35,78 +77,367 @@ Shader::Shader(const std::string & vertexShaderFilename,
         return;
     }
 
-    for (int i = 0; i < sizeof(shaderCodes) / sizeof(std::string); ++i)
+    std::vector<Stage> stages;
+
+    for (int i = 0; i < sizeof(filenames) / sizeof(std::string); ++i)
     {
-        if (shaderCodes[i].empty())
+        if (filenames[i].empty())
         {
             continue;
         }
 
-        GLuint shaderType = 0;
-        
-        if (i == 0)
-            shaderType = GL_VERTEX_SHADER;
-        else
-        if (i == 1)
-            shaderType = GL_FRAGMENT_SHADER;
-        else
-        if (i == 2)
-            shaderType = GL_GEOMETRY_SHADER;
-        else
-        if (i == 3)
-            shaderType = GL_TESS_CONTROL_SHADER;
-        else
-        if (i == 4)
-            shaderType = GL_TESS_EVALUATION_SHADER;
-
-        if (shaderType == 0)
+        stages.push_back(loadStage(shaderTypes[i], filenames[i]));
+    }
+
+    build(stages);
+}
+
+Shader::Shader(const std::string & vertexShaderFilename,
+               const std::string & fragmentShaderFilename,
+               const ShaderDefines & defines,
+               bool parallel)
+               : defines(defines),
+                 program_id(0),
+                 isLinked(false),
+                 parallel(parallel),
+                 pending(false)
+{
+    program_id = glCreateProgram();
+
+    if (program_id == 0)
+    {
+        fprintf(stderr, "Error while creating program object.\n");
+        return;
+    }
+
+    std::vector<Stage> stages;
+    stages.push_back(loadStage(GL_VERTEX_SHADER, vertexShaderFilename));
+    stages.push_back(loadStage(GL_FRAGMENT_SHADER, fragmentShaderFilename));
+    build(stages);
+}
+
+Shader::Shader(const std::string & computeShaderFilename)
+               : program_id(0),
+                 isLinked(false),
+                 parallel(false),
+                 pending(false)
+{
+    program_id = glCreateProgram();
+
+    if (program_id == 0)
+    {
+        fprintf(stderr, "Error while creating program object.\n");
+        return;
+    }
+
+    build(std::vector<Stage>(1, loadStage(GL_COMPUTE_SHADER, computeShaderFilename)));
+}
+
+Shader::Shader(const std::string & computeShaderFilename, const ShaderDefines & defines)
+               : defines(defines),
+                 program_id(0),
+                 isLinked(false),
+                 parallel(false),
+                 pending(false)
+{
+    program_id = glCreateProgram();
+
+    if (program_id == 0)
+    {
+        fprintf(stderr, "Error while creating program object.\n");
+        return;
+    }
+
+    build(std::vector<Stage>(1, loadStage(GL_COMPUTE_SHADER, computeShaderFilename)));
+}
+
+void Shader::enableParallelCompile(GLADloadproc load)
+{
+    if (!gl_extension_supported("GL_KHR_parallel_shader_compile") && !gl_extension_supported("GL_ARB_parallel_shader_compile"))
+    {
+        return;
+    }
+
+    typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+    MaxShaderCompilerThreadsProc maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)load("glMaxShaderCompilerThreadsKHR");
+
+    if (maxShaderCompilerThreads == nullptr)
+    {
+        maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)load("glMaxShaderCompilerThreadsARB");
+    }
+    if (maxShaderCompilerThreads != nullptr)
+    {
+        // as many threads as the driver likes
+        maxShaderCompilerThreads(0xFFFFFFFF);
+    }
+
+    parallelCompile = true;
+}
+
+bool Shader::isParallelCompileEnabled()
+{
+    return parallelCompile;
+}
+
+void Shader::setBinaryCacheDirectory(const std::string & directory)
+{
+    binaryCacheDirectory = directory;
+}
+
+const Shader::BuildStats & Shader::getBuildStats()
+{
+    return buildStats;
+}
+
+Shader::Stage Shader::loadStage(GLuint shaderType, const std::string & filename)
+{
+    Stage stage;
+    stage.type = shaderType;
+    stage.filename = filename;
+    stage.code = injectDefines(loadFile(filename));
+    return stage;
+}
+
+bool Shader::build(const std::vector<Stage> & stages)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    const std::string cacheFile = binaryCacheFile(stages);
+
+    if (!cacheFile.empty() && loadBinary(cacheFile))
+    {
+        buildStats.cached++;
+    }
+    else
+    {
+        for (const Stage & stage : stages)
         {
-            fprintf(stderr, "Error! Wrong shader type.\n");
-            continue;
+            GLuint shaderObject = compileStage(stage);
+
+            if (shaderObject != 0)
+            {
+                glAttachShader(program_id, shaderObject);
+                compiledStages.push_back(std::make_pair(shaderObject, stage.filename));
+            }
+        }
+
+        if (!cacheFile.empty())
+        {
+            glProgramParameteri(program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         }
 
-        GLuint shaderObject = glCreateShader(shaderType);
+        // no status is queried before isReady(), which is what lets the driver compile and link in the background
+        glLinkProgram(program_id);
+        pending = true;
+        pendingCacheFile = cacheFile;
 
-        if (shaderObject == 0)
+        if (!parallel)
         {
-            fprintf(stderr, "Error while creating %s.\n", filenames[i].c_str());
-            continue;
+            finishBuild();
         }
 
-        const char *shaderCode[1] = { shaderCodes[i].c_str() };
+        buildStats.compiled++;
+    }
 
-        glShaderSource (shaderObject, 1, shaderCode, nullptr);
-        glCompileShader(shaderObject);
+    buildStats.milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return isLinked;
+}
 
-        GLint result;
-        glGetShaderiv(shaderObject, GL_COMPILE_STATUS, &result);
+bool Shader::isReady()
+{
+    if (!pending)
+    {
+        return true;
+    }
 
-        if (result == GL_FALSE)
+    if (parallelCompile)
+    {
+        GLint completed = GL_FALSE;
+        glGetProgramiv(program_id, GL_COMPLETION_STATUS_KHR, &completed);
+
+        if (completed == GL_FALSE)
         {
-            fprintf(stderr, "%s compilation failed!\n", filenames[i].c_str());
+            return false;
+        }
+    }
 
-            GLint logLen;
-            glGetShaderiv(shaderObject, GL_INFO_LOG_LENGTH, &logLen);
+    finishBuild();
+    return true;
+}
 
-            if (logLen > 0)
-            {
-                char * log = (char *)malloc(logLen);
+void Shader::finishBuild()
+{
+    pending = false;
 
-                GLsizei written;
-                glGetShaderInfoLog(shaderObject, logLen, &written, log);
+    for (const auto & stage : compiledStages)
+    {
+        checkCompile(stage.first, stage.second);
+        glDeleteShader(stage.first);
+    }
+    compiledStages.clear();
 
-                fprintf(stderr, "Shader log: \n%s", log);
-                free(log);
-            }
+    if (checkLink() && !pendingCacheFile.empty())
+    {
+        saveBinary(pendingCacheFile);
+    }
+}
 
-            continue;
+std::string Shader::binaryCacheFile(const std::vector<Stage> & stages)
+{
+    if (binaryCacheDirectory.empty())
+    {
+        return "";
+    }
+
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+    if (formats == 0)
+    {
+        return "";
+    }
+
+    // a binary is only valid for the exact sources and the driver that produced it
+    uint64_t hash = 14695981039346656037ull;
+
+    for (const Stage & stage : stages)
+    {
+        hash_append(hash, std::to_string(stage.type));
+        hash_append(hash, stage.code);
+    }
+    for (const auto & define : defines)
+    {
+        hash_append(hash, define.first + "=" + define.second);
+    }
+
+    hash_append(hash, (const char *)glGetString(GL_VENDOR));
+    hash_append(hash, (const char *)glGetString(GL_RENDERER));
+    hash_append(hash, (const char *)glGetString(GL_VERSION));
+
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+    return binaryCacheDirectory + name + ".bin";
+}
+
+bool Shader::loadBinary(const std::string & path)
+{
+    std::ifstream file(path, std::ios::binary);
+
+    if (!file)
+    {
+        return false;
+    }
+
+    GLenum format = 0;
+    file.read((char *)&format, sizeof(format));
+    std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    if (binary.empty())
+    {
+        return false;
+    }
+
+    glProgramBinary(program_id, format, binary.data(), (GLsizei)binary.size());
+
+    GLint status;
+    glGetProgramiv(program_id, GL_LINK_STATUS, &status);
+
+    if (status == GL_FALSE)
+    {
+        // e.g. after a driver update that kept the version string; the program is compiled and the file replaced
+        fprintf(stderr, "Cached program binary %s was rejected, compiling.\n", path.c_str());
+        return false;
+    }
+
+    isLinked = true;
+    return true;
+}
+
+void Shader::saveBinary(const std::string & path)
+{
+    GLint length = 0;
+    glGetProgramiv(program_id, GL_PROGRAM_BINARY_LENGTH, &length);
+
+    if (length <= 0)
+    {
+        return;
+    }
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program_id, length, nullptr, &format, binary.data());
+
+    make_directory(binaryCacheDirectory);
+    std::ofstream file(path, std::ios::binary);
+
+    if (!file)
+    {
+        fprintf(stderr, "Could not write program binary %s\n", path.c_str());
+        return;
+    }
+
+    file.write((const char *)&format, sizeof(format));
+    file.write(binary.data(), binary.size());
+}
+
+GLuint Shader::compileStage(const Stage & stage)
+{
+    if (stage.code.empty())
+    {
+        return 0;
+    }
+
+    GLuint shaderObject = glCreateShader(stage.type);
+
+    if (shaderObject == 0)
+    {
+        fprintf(stderr, "Error while creating %s.\n", stage.filename.c_str());
+        return 0;
+    }
+
+    const char *shaderCode[1] = { stage.code.c_str() };
+
+    glShaderSource (shaderObject, 1, shaderCode, nullptr);
+    glCompileShader(shaderObject);
+
+    return shaderObject;
+}
+
+bool Shader::checkCompile(GLuint shaderObject, const std::string & filename)
+{
+    GLint result;
+    glGetShaderiv(shaderObject, GL_COMPILE_STATUS, &result);
+
+    if (result == GL_FALSE)
+    {
+        fprintf(stderr, "%s compilation failed!\n", filename.c_str());
+
+        GLint logLen;
+        glGetShaderiv(shaderObject, GL_INFO_LOG_LENGTH, &logLen);
+
+        if (logLen > 0)
+        {
+            char * log = (char *)malloc(logLen);
+
+            GLsizei written;
+            glGetShaderInfoLog(shaderObject, logLen, &written, log);
+
+            fprintf(stderr, "Shader log: \n%s", log);
+            free(log);
+
+            // the log names lines as source string number and line
+            fprintf(stderr, "Source strings: 0 %s", filename.c_str());
+            for (size_t i = 0; i < sourceFiles.size(); i++)
+            {
+                if (sourceFiles[i] != filename) fprintf(stderr, ", %d %s", (int)i + 1, sourceFiles[i].c_str());
+            }
+            fprintf(stderr, "\n");
         }
 
-        glAttachShader(program_id, shaderObject);
-        glDeleteShader(shaderObject);
+        return false;
     }
 
-    link();
+    return true;
 }
 
 Shader::~Shader()
@@ -118,10 +449,8 @@ Shader::~Shader()
     }
 }
 
-bool Shader::link()
+bool Shader::checkLink()
 {
-    glLinkProgram(program_id);
-
     GLint status;
     glGetProgramiv(program_id, GL_LINK_STATUS, &status);
 
@@ -174,7 +503,7 @@ bool Shader::getUniformLocation(const std::string & uniform_name)
     }
 }
 
-std::string Shader::loadFile(const std::string & filename)
+std::string Shader::loadFile(const std::string & filename, int sourceNumber)
 {
     if (filename.empty())
     {
@@ -186,6 +515,8 @@ std::string Shader::loadFile(const std::string & filename)
 
     std::ifstream inFile(ROOT_DIR "res/shaders/" + filename);
 
+    includeSourceNumber(filename);
+
     if (!inFile)
     {
         fprintf(stderr, "Could not open file %s", filename.c_str());
@@ -195,8 +526,30 @@ std::string Shader::loadFile(const std::string & filename)
     }
     else
     {
+        int lineNumber = 0;
+
         while (getline(inFile, line))
         {
+            lineNumber++;
+
+            // #include "file" pastes another file from res/shaders under its own source string number, so that
+            // compile errors name its lines, then restores the numbering of this one
+            if (line.compare(0, 9, "#include ") == 0)
+            {
+                size_t begin = line.find('"');
+                size_t end = line.find('"', begin + 1);
+
+                if (begin != std::string::npos && end != std::string::npos)
+                {
+                    std::string included = line.substr(begin + 1, end - begin - 1);
+                    int includedNumber = includeSourceNumber(included);
+                    filetext.append("#line 1 " + std::to_string(includedNumber) + "\n");
+                    filetext.append(loadFile(included, includedNumber));
+                    filetext.append("#line " + std::to_string(lineNumber + 1) + " " + std::to_string(sourceNumber) + "\n");
+                    continue;
+                }
+            }
+
             filetext.append(line + "\n");
         }
 
@@ -206,6 +559,98 @@ std::string Shader::loadFile(const std::string & filename)
     }
 }
 
+int Shader::includeSourceNumber(const std::string & filename)
+{
+    auto file = std::find(sourceFiles.begin(), sourceFiles.end(), filename);
+    if (file == sourceFiles.end())
+    {
+        file = sourceFiles.insert(sourceFiles.end(), filename);
+    }
+
+    // 0 is the stage's own file
+    return 1 + (int)(file - sourceFiles.begin());
+}
+
+std::string Shader::injectDefines(const std::string & code)
+{
+    if (defines.empty())
+    {
+        return code;
+    }
+
+    // #version has to stay the first statement, the defines follow it and #line keeps the numbering of the file
+    size_t versionLine = code.find("#version");
+    size_t insertAt = versionLine == std::string::npos ? 0 : code.find('\n', versionLine);
+    if (insertAt == std::string::npos)
+    {
+        return code;
+    }
+    if (versionLine != std::string::npos)
+    {
+        insertAt++;
+    }
+
+    std::string injected;
+    for (const auto & define : defines)
+    {
+        injected.append("#define " + define.first + " " + define.second + "\n");
+    }
+
+    int nextLine = 1;
+    for (size_t i = 0; i < insertAt; ++i)
+    {
+        if (code[i] == '\n') nextLine++;
+    }
+    injected.append("#line " + std::to_string(nextLine) + "\n");
+
+    return code.substr(0, insertAt) + injected + code.substr(insertAt);
+}
+
+GLint Shader::resolveUniform(const std::string & uniformName)
+{
+    if (uniformsLocations.count(uniformName) || getUniformLocation(uniformName))
+    {
+        return uniformsLocations[uniformName];
+    }
+
+    return -1;
+}
+
+void Shader::set(Uniform<int> uniform, int value)
+{
+    glProgramUniform1i(program_id, uniform.location, value);
+}
+
+void Shader::set(Uniform<unsigned int> uniform, unsigned int value)
+{
+    glProgramUniform1ui(program_id, uniform.location, value);
+}
+
+void Shader::set(Uniform<float> uniform, float value)
+{
+    glProgramUniform1f(program_id, uniform.location, value);
+}
+
+void Shader::set(Uniform<glm::vec2> uniform, const glm::vec2 & value)
+{
+    glProgramUniform2fv(program_id, uniform.location, 1, glm::value_ptr(value));
+}
+
+void Shader::set(Uniform<glm::vec3> uniform, const glm::vec3 & value)
+{
+    glProgramUniform3fv(program_id, uniform.location, 1, glm::value_ptr(value));
+}
+
+void Shader::set(Uniform<glm::vec4> uniform, const glm::vec4 & value)
+{
+    glProgramUniform4fv(program_id, uniform.location, 1, glm::value_ptr(value));
+}
+
+void Shader::set(Uniform<glm::mat4> uniform, const glm::mat4 & value)
+{
+    glProgramUniformMatrix4fv(program_id, uniform.location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
 void Shader::setUniform1f(const std::string & uniformName, float value)
 {
     if (uniformsLocations.count(uniformName))
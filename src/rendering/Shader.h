@@ -5,18 +5,81 @@
 
 #include <map>
 #include <string>
+#include <vector>
+
+// Preprocessor symbols and their values, injected right after the #version line of every stage.
+typedef std::map<std::string, std::string> ShaderDefines;
 
 class Shader
 {
 public:
+    // programs built so far, and the time spent on loading and compiling them
+    struct BuildStats
+    {
+        int cached;
+        int compiled;
+        double milliseconds;
+    };
+
     Shader(const std::string & vertexShaderFilename,
            const std::string & fragmentShaderFilename,
            const std::string & geometryShaderFilename               = "",
            const std::string & tessellationControlShaderFilename    = "",
            const std::string & tessellationEvaluationShaderFilename = "");
 
+    // parallel leaves the compile and link running in the driver, see isReady()
+    Shader(const std::string & vertexShaderFilename,
+           const std::string & fragmentShaderFilename,
+           const ShaderDefines & defines,
+           bool parallel = false);
+
+    explicit Shader(const std::string & computeShaderFilename);
+    Shader(const std::string & computeShaderFilename, const ShaderDefines & defines);
+
     virtual ~Shader();
 
+    // Linked programs are stored there as binaries, keyed by a hash of their sources, defines and the
+    // driver, and loaded instead of compiling the next time. Defaults to shader_cache/ in the project root,
+    // empty disables the cache.
+    static void setBinaryCacheDirectory(const std::string & directory);
+    static const BuildStats & getBuildStats();
+
+    // Uses KHR_parallel_shader_compile if the driver has it, so that parallel builds run on driver threads.
+    // Without it a parallel build completes on its first isReady(). load resolves the entry points glad lacks.
+    static void enableParallelCompile(GLADloadproc load);
+    static bool isParallelCompileEnabled();
+
+    // False while a parallel build is still compiling; once it is done, reports errors and returns true.
+    bool isReady();
+    bool hasLinked() const { return isLinked; }
+
+    // res/shaders files the program was built from, #included ones too
+    const std::vector<std::string> & getSourceFiles() const { return sourceFiles; }
+
+    // A uniform location resolved once by getUniform, so that setting it needs no name lookup.
+    // Only valid for the program it was resolved on.
+    template <typename T>
+    struct Uniform
+    {
+        GLint location = -1;
+    };
+
+    template <typename T>
+    Uniform<T> getUniform(const std::string & uniformName)
+    {
+        Uniform<T> uniform;
+        uniform.location = resolveUniform(uniformName);
+        return uniform;
+    }
+
+    void set(Uniform<int> uniform, int value);
+    void set(Uniform<unsigned int> uniform, unsigned int value);
+    void set(Uniform<float> uniform, float value);
+    void set(Uniform<glm::vec2> uniform, const glm::vec2 & value);
+    void set(Uniform<glm::vec3> uniform, const glm::vec3 & value);
+    void set(Uniform<glm::vec4> uniform, const glm::vec4 & value);
+    void set(Uniform<glm::mat4> uniform, const glm::mat4 & value);
+
     void setUniform1f       (const std::string & uniformName, float value);
     void setUniform1i       (const std::string & uniformName, int value);
     void setUniform1ui      (const std::string & uniformName, unsigned int value);
@@ -38,13 +101,42 @@ public:
     void apply();
 
 private:
+    struct Stage
+    {
+        GLuint type;
+        std::string filename;
+        std::string code;
+    };
+
+    static std::string binaryCacheDirectory;
+    static BuildStats buildStats;
+    static bool parallelCompile;
+
     std::map<std::string, GLint> uniformsLocations;
+    ShaderDefines defines;
 
     GLuint program_id;
     bool isLinked;
+    bool parallel;
+    bool pending;
+    std::vector<std::pair<GLuint, std::string>> compiledStages;
+    std::string pendingCacheFile;
+    std::vector<std::string> sourceFiles;
 
-    bool link();
+    Stage loadStage(GLuint shaderType, const std::string & filename);
+    bool build(const std::vector<Stage> & stages);
+    void finishBuild();
+    std::string binaryCacheFile(const std::vector<Stage> & stages);
+    bool loadBinary(const std::string & path);
+    void saveBinary(const std::string & path);
+    GLuint compileStage(const Stage & stage);
+    bool checkCompile(GLuint shaderObject, const std::string & filename);
+    bool checkLink();
     bool getUniformLocation(const std::string & uniform_name);
-    std::string loadFile(const std::string & filename);
+    GLint resolveUniform(const std::string & uniformName);
+    // sourceNumber is the GLSL source string number of the file, 0 for a stage's own file
+    std::string loadFile(const std::string & filename, int sourceNumber = 0);
+    int includeSourceNumber(const std::string & filename);
+    std::string injectDefines(const std::string & code);
 };
 
@@ -0,0 +1,113 @@
+#include "ShaderVariants.h"
+
+#include <iostream>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <helpers/RootDir.h>
+
+// saving a file is noticed within this time, without a stat call per file every frame
+static const std::chrono::milliseconds CHECK_INTERVAL(250);
+
+static time_t modification_time(const std::string& file)
+{
+	struct stat info;
+	if (stat((ROOT_DIR "res/shaders/" + file).c_str(), &info) != 0) return 0;
+	return info.st_mtime;
+}
+
+ShaderVariants::ShaderVariants(const std::string& vertex_file, const std::string& fragment_file)
+	: vertex_file(vertex_file), fragment_file(fragment_file), next_check(std::chrono::steady_clock::now())
+{
+}
+
+ShaderVariants::~ShaderVariants()
+{
+	for (auto& variant : variants) delete variant.second;
+	for (auto& rebuild : rebuilds) delete rebuild.second;
+}
+
+Shader* ShaderVariants::get(const ShaderDefines& defines)
+{
+	auto it = variants.find(defines);
+	if (it != variants.end()) return it->second;
+
+	std::cout << "Compiling " << fragment_file << " with";
+	for (const auto& define : defines) std::cout << " " << define.first << "=" << define.second;
+	std::cout << std::endl;
+
+	Shader* variant = new Shader(vertex_file, fragment_file, defines);
+	variants[defines] = variant;
+	watch(*variant);
+	return variant;
+}
+
+void ShaderVariants::watch(const Shader& shader)
+{
+	for (const std::string& file : shader.getSourceFiles())
+	{
+		if (watched_files.count(file) == 0) watched_files[file] = modification_time(file);
+	}
+}
+
+bool ShaderVariants::sourcesChanged()
+{
+	bool changed = false;
+	for (auto& file : watched_files)
+	{
+		time_t time = modification_time(file.first);
+		if (time != file.second)
+		{
+			file.second = time;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+bool ShaderVariants::update()
+{
+	bool replaced = false;
+
+	for (auto it = rebuilds.begin(); it != rebuilds.end();)
+	{
+		Shader* rebuild = it->second;
+		if (!rebuild->isReady())
+		{
+			++it;
+			continue;
+		}
+
+		if (rebuild->hasLinked())
+		{
+			delete variants[it->first];
+			variants[it->first] = rebuild;
+			watch(*rebuild);
+			replaced = true;
+		}
+		else
+		{
+			std::cout << fragment_file << " did not build, the previous program stays in use" << std::endl;
+			delete rebuild;
+		}
+		it = rebuilds.erase(it);
+	}
+	if (replaced) std::cout << "Reloaded " << fragment_file << std::endl;
+
+	auto now = std::chrono::steady_clock::now();
+	if (now < next_check) return replaced;
+	next_check = now + CHECK_INTERVAL;
+
+	if (!sourcesChanged()) return replaced;
+
+	std::cout << "Shader sources changed, rebuilding " << variants.size() << " variant(s)"
+		<< (Shader::isParallelCompileEnabled() ? " in the background" : "") << std::endl;
+	for (auto& variant : variants)
+	{
+		// a rebuild still running was started from older sources
+		auto running = rebuilds.find(variant.first);
+		if (running != rebuilds.end()) delete running->second;
+		rebuilds[variant.first] = new Shader(vertex_file, fragment_file, variant.first, true);
+	}
+
+	return replaced;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <chrono>
+#include <ctime>
+#include <map>
+#include <string>
+#include <rendering/Shader.h>
+
+// Compiled variants of one vertex and fragment shader pair, keyed by the set of defines they were
+// compiled with. Switching back to a set used before reuses its program instead of compiling again.
+class ShaderVariants
+{
+public:
+	ShaderVariants(const std::string& vertex_file, const std::string& fragment_file);
+	~ShaderVariants();
+
+	// Returns the variant for defines, compiling it on first use. The cache owns the program.
+	Shader* get(const ShaderDefines& defines);
+
+	size_t getCount() const { return variants.size(); }
+
+	// Hot reload, call once per frame: when a source file of the variants changed on disk, all of them are
+	// rebuilt in parallel builds while the old programs keep rendering. A rebuild replaces its variant once
+	// it links; a failed one is dropped. Returns true when a variant was replaced, which deletes the old
+	// program, so pointers from get() must be fetched again.
+	bool update();
+
+private:
+	std::string vertex_file;
+	std::string fragment_file;
+	std::map<ShaderDefines, Shader*> variants;
+	std::map<ShaderDefines, Shader*> rebuilds;
+	// modification times of the source files of all variants
+	std::map<std::string, time_t> watched_files;
+	std::chrono::steady_clock::time_point next_check;
+
+	void watch(const Shader& shader);
+	bool sourcesChanged();
+};
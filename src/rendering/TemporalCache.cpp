@@ -0,0 +1,87 @@
+#include "TemporalCache.h"
+
+#include <algorithm>
+
+// after the visibility buffer; the outputs use image units 0 .. TARGETS - 1
+static const int FIRST_UNIT = 25;
+static const GLenum FORMATS[3] = { GL_RGBA32F, GL_RGBA16F, GL_RGBA16F };
+static const char* INPUTS[3] = { "history_position", "history_normal", "history_radiance" };
+
+TemporalCache::TemporalCache()
+	: clear_fbo(0), current(0), width(0), height(0), history_length(4), valid(false)
+{
+	for (int set = 0; set < 2; set++) std::fill(textures[set], textures[set] + TARGETS, 0);
+	glGenFramebuffers(1, &clear_fbo);
+}
+
+TemporalCache::~TemporalCache()
+{
+	glDeleteFramebuffers(1, &clear_fbo);
+	if (textures[0][0] != 0) glDeleteTextures(2 * TARGETS, &textures[0][0]);
+}
+
+void TemporalCache::setUniforms(Shader& tracer)
+{
+	for (int i = 0; i < TARGETS; i++) tracer.setUniform1i(INPUTS[i], FIRST_UNIT + i);
+	tracer_history_length = tracer.getUniform<unsigned int>("history_length");
+}
+
+void TemporalCache::setHistoryLength(int frames)
+{
+	history_length = std::max(2, std::min(frames, MAX_HISTORY));
+}
+
+void TemporalCache::createTargets()
+{
+	if (textures[0][0] != 0) glDeleteTextures(2 * TARGETS, &textures[0][0]);
+	glGenTextures(2 * TARGETS, &textures[0][0]);
+
+	// on our own units, the scene textures are bound already
+	glActiveTexture(GL_TEXTURE0 + FIRST_UNIT);
+	for (int set = 0; set < 2; set++)
+	{
+		for (int i = 0; i < TARGETS; i++)
+		{
+			glBindTexture(GL_TEXTURE_2D, textures[set][i]);
+			glTexStorage2D(GL_TEXTURE_2D, 1, FORMATS[i], width, height);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		}
+	}
+	valid = false;
+}
+
+void TemporalCache::bind(Shader& tracer, int width, int height)
+{
+	if (width != this->width || height != this->height)
+	{
+		this->width = width;
+		this->height = height;
+		createTargets();
+	}
+
+	current = 1 - current;
+	int previous = 1 - current;
+
+	if (!valid)
+	{
+		// object class 0 in the positions matches no hit, so every pixel traces its secondary rays
+		const GLfloat empty[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		glBindFramebuffer(GL_FRAMEBUFFER, clear_fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[previous][0], 0);
+		glClearBufferfv(GL_COLOR, 0, empty);
+		valid = true;
+	}
+
+	// the last frame wrote its history with image stores
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+	for (int i = 0; i < TARGETS; i++)
+	{
+		glActiveTexture(GL_TEXTURE0 + FIRST_UNIT + i);
+		glBindTexture(GL_TEXTURE_2D, textures[previous][i]);
+		glBindImageTexture(i, textures[current][i], 0, GL_FALSE, 0, GL_WRITE_ONLY, FORMATS[i]);
+	}
+
+	tracer.set(tracer_history_length, (unsigned int)history_length);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <rendering/Shader.h>
+
+// Temporal reprojection of the fragment tracer's secondary rays. The single-sample passes of a tracer variant
+// compiled with TEMPORAL_CACHE write the primary hit, its normal and the radiance of every ray after the primary
+// one into a history, one set of targets per frame. The next frame reprojects each primary hit into the last
+// frame and reuses the radiance found there if it is the same surface; only the pixels whose turn it is in a
+// rotating order, the disoccluded ones and those whose history is too old trace their secondary rays.
+class TemporalCache
+{
+public:
+	static const int MAX_HISTORY = 16;
+
+	TemporalCache();
+	~TemporalCache();
+
+	// Assigns the history inputs of a tracer variant compiled with TEMPORAL_CACHE to their texture units.
+	// bind() must be given the tracer of the last call.
+	void setUniforms(Shader& tracer);
+
+	// Frames a traced secondary result is used for, which bounds ghosting; clamped to 2 .. MAX_HISTORY.
+	void setHistoryLength(int frames);
+	int getHistoryLength() const { return history_length; }
+
+	// Forgets the history; call when the scene or the tracer changed.
+	void reset() { valid = false; }
+
+	// Makes the history written by the last bind the input and binds the other set (resized if the window size
+	// changed) as the output of the next single-sample pass.
+	void bind(Shader& tracer, int width, int height);
+
+private:
+	// primary hit position and object class, normal and age, secondary radiance
+	static const int TARGETS = 3;
+
+	Shader::Uniform<unsigned int> tracer_history_length;
+	GLuint textures[2][TARGETS];
+	GLuint clear_fbo;
+	int current;
+	int width;
+	int height;
+	int history_length;
+	bool valid;
+
+	void createTargets();
+};
@@ -5,7 +5,7 @@
 #include <helpers/RootDir.h>
 
 Texture::Texture()
-    : use_linear(true), to_id(0)
+    : use_linear(true), mip_filter(MipChain::Filter::Kaiser), to_id(0)
 {
 }
 
@@ -18,7 +18,7 @@ Texture::~Texture()
     }
 }
 
-bool Texture::load(const std::string & file_name)
+bool Texture::load(const std::string & file_name, MipChain::Content content)
 {
     if(file_name.empty())
     {
@@ -35,14 +35,19 @@ bool Texture::load(const std::string & file_name)
         glGenTextures(1, &to_id);
         glBindTexture(GL_TEXTURE_2D, to_id);
         
-        glTexStorage2D(GL_TEXTURE_2D, 2 /* mip map levels */, GL_RGB8, width, height);
-        glTexSubImage2D(GL_TEXTURE_2D, 0 /* mip map level */, 0 /* xoffset */, 0 /* yoffset */, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        std::vector<MipChain::Level> levels = MipChain::build(width, height, pixels, content, mip_filter);
+        glTexStorage2D(GL_TEXTURE_2D, (GLsizei)levels.size(), GL_RGB8, width, height);
+        for(size_t level = 0; level < levels.size(); level++)
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, (GLint)level /* mip map level */, 0 /* xoffset */, 0 /* yoffset */, levels[level].width, levels[level].height, GL_RGBA, GL_UNSIGNED_BYTE, levels[level].pixels.data());
+        }
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+        is_loaded = true;
     }
     else
     {
@@ -1,6 +1,7 @@
 ﻿#pragma once
 #include <string>
 #include <glad/glad.h>
+#include <rendering/MipChain.h>
 
 class Texture
 {
@@ -8,7 +9,8 @@ public:
     Texture();
     ~Texture();
 
-    bool load(const std::string & file_name);
+    // Uploads the image with a full mip chain built by MipChain.
+    bool load(const std::string & file_name, MipChain::Content content = MipChain::Content::Color);
     
     void bind(int index = 0) const
     {
@@ -20,6 +22,7 @@ public:
     }
 
     bool use_linear;
+    MipChain::Filter mip_filter;
 
 private:
     GLuint to_id;
@@ -0,0 +1,178 @@
+#include <stb_image.h>
+
+#include "TextureSet.h"
+
+#include <iostream>
+#include <helpers/GLExtensions.h>
+#include <helpers/RootDir.h>
+
+// alpha is dropped; the color levels stay sRGB-encoded, they are only filtered in linear space
+static const GLenum TEXTURE_FORMAT = GL_RGB8;
+static const GLuint SLOT_BINDING = 8;
+
+static void set_sampling(GLenum target)
+{
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+}
+
+TextureSet::TextureSet(GLADloadproc load)
+	: slot_buffer(0), bindless(false), mip_filter(MipChain::Filter::Kaiser), getTextureHandle(nullptr), makeTextureHandleResident(nullptr), makeTextureHandleNonResident(nullptr)
+{
+	if (gl_extension_supported("GL_ARB_bindless_texture"))
+	{
+		getTextureHandle = (GetTextureHandleProc)load("glGetTextureHandleARB");
+		makeTextureHandleResident = (MakeTextureHandleResidentProc)load("glMakeTextureHandleResidentARB");
+		makeTextureHandleNonResident = (MakeTextureHandleResidentProc)load("glMakeTextureHandleNonResidentARB");
+		bindless = getTextureHandle && makeTextureHandleResident && makeTextureHandleNonResident;
+	}
+
+	glGenBuffers(1, &slot_buffer);
+}
+
+TextureSet::~TextureSet()
+{
+	for (GLuint64 handle : handles) makeTextureHandleNonResident(handle);
+	if (!textures.empty()) glDeleteTextures((GLsizei)textures.size(), textures.data());
+	glDeleteBuffers(1, &slot_buffer);
+}
+
+int TextureSet::add(const std::string& file_name, MipChain::Content content)
+{
+	int width, height, components;
+	unsigned char* pixels = stbi_load((ROOT_DIR + file_name).c_str(), &width, &height, &components, 4);
+	if (pixels == nullptr)
+	{
+		std::cout << "Could not load file " << file_name << std::endl;
+		return -1;
+	}
+
+	PendingImage image;
+	image.width = width;
+	image.height = height;
+	image.levels = MipChain::build(width, height, pixels, content, mip_filter);
+	stbi_image_free(pixels);
+
+	images.push_back(std::move(image));
+	return (int)images.size() - 1;
+}
+
+void TextureSet::uploadBindless(std::vector<Slot>& slots)
+{
+	textures.resize(images.size());
+	glGenTextures((GLsizei)textures.size(), textures.data());
+
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+		const std::vector<MipChain::Level>& levels = images[i].levels;
+		glTexStorage2D(GL_TEXTURE_2D, (GLsizei)levels.size(), TEXTURE_FORMAT, images[i].width, images[i].height);
+		for (size_t level = 0; level < levels.size(); level++)
+		{
+			glTexSubImage2D(GL_TEXTURE_2D, (GLint)level, 0, 0, levels[level].width, levels[level].height, GL_RGBA, GL_UNSIGNED_BYTE, levels[level].pixels.data());
+		}
+		set_sampling(GL_TEXTURE_2D);
+
+		// the texture's state is frozen once it has a handle
+		GLuint64 handle = getTextureHandle(textures[i]);
+		makeTextureHandleResident(handle);
+		handles.push_back(handle);
+		slots[i].handle = handle;
+	}
+}
+
+bool TextureSet::uploadArrays(std::vector<Slot>& slots)
+{
+	// every distinct size becomes one array, with the textures of that size as its layers
+	std::vector<int> group_width, group_height;
+	std::vector<std::vector<int>> group_images;
+
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		size_t group = 0;
+		while (group < group_images.size() && (group_width[group] != images[i].width || group_height[group] != images[i].height)) group++;
+
+		if (group == group_images.size())
+		{
+			if (group == MAX_ARRAYS)
+			{
+				std::cout << "More than " << MAX_ARRAYS << " texture sizes, texture " << i << " is not used" << std::endl;
+				slots[i].array = -1;
+				continue;
+			}
+			group_width.push_back(images[i].width);
+			group_height.push_back(images[i].height);
+			group_images.push_back(std::vector<int>());
+		}
+
+		slots[i].array = (GLint)group;
+		slots[i].layer = (GLint)group_images[group].size();
+		group_images[group].push_back((int)i);
+	}
+
+	GLint max_layers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+
+	textures.resize(group_images.size());
+	if (!textures.empty()) glGenTextures((GLsizei)textures.size(), textures.data());
+
+	for (size_t group = 0; group < group_images.size(); group++)
+	{
+		GLsizei layers = (GLsizei)group_images[group].size();
+		if (layers > max_layers)
+		{
+			std::cout << layers << " textures of " << group_width[group] << "x" << group_height[group] << " exceed the " << max_layers << " array layers" << std::endl;
+			return false;
+		}
+
+		glActiveTexture(GL_TEXTURE0 + (GLenum)group);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, textures[group]);
+		// images of the same size have chains of the same length
+		GLsizei level_count = (GLsizei)images[group_images[group][0]].levels.size();
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, level_count, TEXTURE_FORMAT, group_width[group], group_height[group], layers);
+		for (GLsizei layer = 0; layer < layers; layer++)
+		{
+			for (GLsizei level = 0; level < level_count; level++)
+			{
+				const MipChain::Level& mip = images[group_images[group][layer]].levels[level];
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, mip.width, mip.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, mip.pixels.data());
+			}
+		}
+		set_sampling(GL_TEXTURE_2D_ARRAY);
+	}
+
+	return true;
+}
+
+bool TextureSet::upload()
+{
+	std::vector<Slot> slots(images.size());
+	for (Slot& slot : slots)
+	{
+		slot.handle = 0;
+		slot.array = -1;
+		slot.layer = 0;
+	}
+
+	if (bindless) uploadBindless(slots);
+	else if (!uploadArrays(slots)) return false;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, slot_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, slots.size() * sizeof(Slot), slots.data(), GL_STATIC_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SLOT_BINDING, slot_buffer);
+
+	// the pixels live on the GPU now
+	images.assign(images.size(), PendingImage());
+	return true;
+}
+
+void TextureSet::setUniforms(Shader& shader) const
+{
+	for (int i = 0; i < MAX_ARRAYS; i++)
+	{
+		shader.setUniform1i("texture_arrays[" + std::to_string(i) + "]", i);
+	}
+	if (bindless) shader.setUniform1i("bindless_textures", 1);
+}
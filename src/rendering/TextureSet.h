@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include <rendering/MipChain.h>
+#include <rendering/Shader.h>
+
+// Scene textures of the GPU tracers. Materials refer to a texture by its index, which the shaders resolve
+// through a slot buffer (binding 8): with ARB_bindless_texture a slot holds a resident texture handle,
+// otherwise the textures are grouped by size and format into texture arrays and a slot holds array and layer.
+// Everything is bound once on upload, so frames make no texture bind calls however many textures there are.
+class TextureSet
+{
+public:
+	// mirrors MAX_TEXTURE_ARRAYS in RaytraceCommon.glsl, the arrays use units 0 .. MAX_ARRAYS - 1
+	static const int MAX_ARRAYS = 8;
+
+	// load resolves the bindless entry points, which glad does not provide
+	explicit TextureSet(GLADloadproc load);
+	~TextureSet();
+
+	// Filter of the mip chains of the textures added from now on, Kaiser by default.
+	void setMipFilter(MipChain::Filter filter) { mip_filter = filter; }
+
+	// Reads an image file relative to the project root and builds its mip chain; returns its index for
+	// Material::textures or -1.
+	int add(const std::string& file_name, MipChain::Content content = MipChain::Content::Color);
+
+	// Creates the GL textures and the slot buffer from everything added and binds them. Call once.
+	bool upload();
+
+	// Points the sampler uniforms of a program that includes RaytraceCommon.glsl at the arrays.
+	void setUniforms(Shader& shader) const;
+
+	bool isBindless() const { return bindless; }
+	int getCount() const { return (int)images.size(); }
+
+private:
+	struct PendingImage
+	{
+		int width;
+		int height;
+		// from the full size down to 1x1
+		std::vector<MipChain::Level> levels;
+	};
+
+	// std430 layout of TextureSlot
+	struct Slot
+	{
+		GLuint64 handle;
+		GLint array;
+		GLint layer;
+	};
+
+	typedef GLuint64 (APIENTRYP GetTextureHandleProc)(GLuint texture);
+	typedef void (APIENTRYP MakeTextureHandleResidentProc)(GLuint64 handle);
+
+	std::vector<PendingImage> images;
+	std::vector<GLuint> textures;
+	std::vector<GLuint64> handles;
+	GLuint slot_buffer;
+	bool bindless;
+	MipChain::Filter mip_filter;
+	GetTextureHandleProc getTextureHandle;
+	MakeTextureHandleResidentProc makeTextureHandleResident;
+	MakeTextureHandleResidentProc makeTextureHandleNonResident;
+
+	void uploadBindless(std::vector<Slot>& slots);
+	bool uploadArrays(std::vector<Slot>& slots);
+};
@@ -0,0 +1,91 @@
+#include "VisibilityBuffer.h"
+
+// after the units of the adaptive sampler
+static const int OBJECT_UNIT = 24;
+// Visibility.vert draws every sphere as a quad and every triangle as itself
+static const GLsizei SPHERE_VERTICES = 6;
+static const GLsizei TRIANGLE_VERTICES = 3;
+
+VisibilityBuffer::VisibilityBuffer(bool guide)
+	: shader(nullptr), guide(guide), fbo(0), object_texture(0), depth_texture(0), width(0), height(0)
+{
+	shader = new Shader("Visibility.vert", "Visibility.frag");
+	guide_pixel_size = shader->getUniform<glm::vec2>("guide_pixel_size");
+	glGenFramebuffers(1, &fbo);
+}
+
+VisibilityBuffer::~VisibilityBuffer()
+{
+	glDeleteFramebuffers(1, &fbo);
+	if (object_texture != 0)
+	{
+		GLuint textures[2] = { object_texture, depth_texture };
+		glDeleteTextures(2, textures);
+	}
+	delete shader;
+}
+
+void VisibilityBuffer::setUniforms(Shader& tracer) const
+{
+	tracer.setUniform1i("visibility", OBJECT_UNIT);
+}
+
+void VisibilityBuffer::createTargets()
+{
+	if (object_texture != 0)
+	{
+		GLuint textures[2] = { object_texture, depth_texture };
+		glDeleteTextures(2, textures);
+	}
+
+	GLuint textures[2];
+	glGenTextures(2, textures);
+	object_texture = textures[0];
+	depth_texture = textures[1];
+
+	// on our own unit, the scene textures are bound already
+	glActiveTexture(GL_TEXTURE0 + OBJECT_UNIT);
+	// the depth is the hit distance scaled by a power of two, which needs every bit of a float
+	const GLenum formats[2] = { GL_R32UI, GL_DEPTH_COMPONENT32F };
+	for (int i = 0; i < 2; i++)
+	{
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+		glTexStorage2D(GL_TEXTURE_2D, 1, formats[i], width, height);
+		// integer textures are incomplete with linear filtering
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, object_texture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth_texture, 0);
+}
+
+void VisibilityBuffer::render(int width, int height, unsigned sphere_count, unsigned triangle_count)
+{
+	if (width != this->width || height != this->height)
+	{
+		this->width = width;
+		this->height = height;
+		createTargets();
+		if (guide) shader->set(guide_pixel_size, glm::vec2(1.0f / width, 1.0f / height));
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	const GLuint no_object[4] = { 0, 0, 0, 0 };
+	const GLfloat far_depth = 1.0f;
+	glClearBufferuiv(GL_COLOR, 0, no_object);
+	glClearBufferfv(GL_DEPTH, 0, &far_depth);
+
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+	glDisable(GL_BLEND);
+
+	// the geometry comes from the scene buffers by vertex index, no attribute array is enabled
+	shader->apply();
+	glDrawArrays(GL_TRIANGLES, 0, (GLsizei)sphere_count * SPHERE_VERTICES + (GLsizei)triangle_count * TRIANGLE_VERTICES);
+
+	if (guide) return;
+	glActiveTexture(GL_TEXTURE0 + OBJECT_UNIT);
+	glBindTexture(GL_TEXTURE_2D, object_texture);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <rendering/Shader.h>
+
+// Rasterized primary visibility for the hybrid fragment tracer. The spheres (as screen-space impostors) and
+// triangles of the scene buffers are drawn into an object ID target; every fragment runs the tracer's own
+// intersection test and writes the exact hit distance as its depth, so the closest object per pixel is the one
+// a traced primary ray finds. A tracer variant compiled with VISIBILITY_BUFFER then intersects only that object
+// and the ground plane for the primary ray and traces the shadow, reflection and refraction rays as before.
+// A guide buffer samples the pixel centers of its own size instead, as the geometry guide of BilateralUpscaler.
+class VisibilityBuffer
+{
+public:
+	explicit VisibilityBuffer(bool guide = false);
+	~VisibilityBuffer();
+
+	// Points the visibility sampler of a tracer variant compiled with VISIBILITY_BUFFER at the target.
+	void setUniforms(Shader& tracer) const;
+
+	// Rasterizes the scene buffers into the target (resized if the window size changed), sampling every pixel
+	// at the jitter of the Frame block, and binds it for the tracer; a guide only samples its pixel centers.
+	// Leaves the target framebuffer bound.
+	void render(int width, int height, unsigned sphere_count, unsigned triangle_count);
+
+	// object IDs, 0 for none, and hit distances scaled by 2^-32, 1 for none
+	GLuint getObjectTexture() const { return object_texture; }
+	GLuint getDepthTexture() const { return depth_texture; }
+
+private:
+	Shader* shader;
+	Shader::Uniform<glm::vec2> guide_pixel_size;
+	bool guide;
+	GLuint fbo;
+	GLuint object_texture;
+	GLuint depth_texture;
+	int width;
+	int height;
+
+	void createTargets();
+};
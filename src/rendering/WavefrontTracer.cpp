@@ -0,0 +1,141 @@
+#include "WavefrontTracer.h"
+
+#include <algorithm>
+
+static const int RECURSION_DEPTH = 5;
+
+WavefrontTracer::WavefrontTracer(const TextureSet& textures)
+	: generate(nullptr), extend(nullptr), shade(nullptr), shadow(nullptr), queue(nullptr), present(nullptr),
+	  ray_queues(), shadow_queue(0), state(0), width(0), height(0), light_count(0), ray_capacity(0), shadow_capacity(0)
+{
+	generate = new Shader("WavefrontGenerate.comp");
+	extend = new Shader("WavefrontExtend.comp");
+	shade = new Shader("WavefrontShade.comp");
+	shadow = new Shader("WavefrontShadow.comp");
+	queue = new Shader("WavefrontQueue.comp");
+	present = new Shader("Basic.vert", "WavefrontPresent.frag");
+
+	textures.setUniforms(*shade);
+	textures.setUniforms(*shadow);
+	queue_stage = queue->getUniform<unsigned int>("stage");
+
+	glGenBuffers(2, ray_queues);
+	glGenBuffers(1, &shadow_queue);
+	glGenBuffers(1, &state);
+}
+
+WavefrontTracer::~WavefrontTracer()
+{
+	glDeleteBuffers(2, ray_queues);
+	glDeleteBuffers(1, &shadow_queue);
+	glDeleteBuffers(1, &state);
+
+	delete generate;
+	delete extend;
+	delete shade;
+	delete shadow;
+	delete queue;
+	delete present;
+}
+
+void WavefrontTracer::resize(int width, int height, unsigned light_count)
+{
+	light_count = std::max(1u, light_count);
+	if (width == this->width && height == this->height && light_count == this->light_count) return;
+
+	this->width = width;
+	this->height = height;
+	this->light_count = light_count;
+
+	// the primary rays fill a queue exactly (padded to whole 8x8 tiles); secondary and shadow rays beyond
+	// that are dropped and reported, which only happens when most of the frame is reflective or transparent
+	GLuint tiles = (GLuint)(((width + 7) / 8) * ((height + 7) / 8));
+	ray_capacity = tiles * GROUP_SIZE;
+	shadow_capacity = ray_capacity * light_count;
+
+	for (int i = 0; i < 2; i++)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, ray_queues[i]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, ray_capacity * RAY_SIZE, nullptr, GL_DYNAMIC_COPY);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, shadow_queue);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, shadow_capacity * SHADOW_RAY_SIZE, nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, state);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, STATE_HEADER_SIZE + (GLsizeiptr)width * height * 3 * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+
+	generate->setUniform2fv("image_size", glm::vec2(width, height));
+	present->setUniform2fv("image_size", glm::vec2(width, height));
+}
+
+void WavefrontTracer::setGroundPlane(const glm::vec4& plane)
+{
+	extend->setUniform4fv("ground_plane", plane);
+	shade->setUniform4fv("ground_plane", plane);
+	shadow->setUniform4fv("ground_plane", plane);
+}
+
+void WavefrontTracer::setRouletteDepth(int depth)
+{
+	shade->setUniform1i("roulette_depth", depth);
+}
+
+void WavefrontTracer::render()
+{
+	GLuint tiles_x = (width + 7) / 8;
+	GLuint tiles_y = (height + 7) / 8;
+	GLuint primary_rays = tiles_x * tiles_y * GROUP_SIZE;
+
+	const GLuint header[12] = { tiles_x * tiles_y, 1, 1, primary_rays, 0, 1, 1, 0, 0, ray_capacity, shadow_capacity, 0 };
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, state);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(header), header);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, shadow_queue);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, state);
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, state);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, ray_queues[0]);
+	generate->apply();
+	glDispatchCompute(tiles_x, tiles_y, 1);
+
+	for (int depth = 0; depth < RECURSION_DEPTH; depth++)
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, ray_queues[depth % 2]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, ray_queues[(depth + 1) % 2]);
+
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+		extend->apply();
+		glDispatchComputeIndirect(0);
+
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		shade->apply();
+		glDispatchComputeIndirect(0);
+
+		dispatchQueue(0);
+
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+		shadow->apply();
+		glDispatchComputeIndirect(4 * sizeof(GLuint));
+
+		dispatchQueue(1);
+	}
+
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	present->apply();
+}
+
+void WavefrontTracer::dispatchQueue(GLuint stage)
+{
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	queue->set(queue_stage, stage);
+	queue->apply();
+	glDispatchCompute(1, 1, 1);
+}
+
+unsigned WavefrontTracer::getDroppedRays()
+{
+	GLuint dropped = 0;
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, state);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 11 * sizeof(GLuint), sizeof(GLuint), &dropped);
+	return dropped;
+}
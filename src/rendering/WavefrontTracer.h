@@ -0,0 +1,59 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <rendering/Shader.h>
+#include <rendering/TextureSet.h>
+
+// Compute variant of Raytrace.frag. Instead of one fragment megakernel with a ray stack per pixel, each
+// bounce runs separate kernels for closest hits, shading and shadow rays, which pass their work through
+// SSBO queues sized by atomic counters and indirect dispatches. Uses the scene buffers at bindings 0-3,
+// the texture slots at 8 and the camera of the Frame uniform block; binds its own queues at 4-7.
+class WavefrontTracer
+{
+public:
+	static const int GROUP_SIZE = 64;
+
+	explicit WavefrontTracer(const TextureSet& textures);
+	~WavefrontTracer();
+
+	// Allocates the queues for the given frame size and light count; does nothing if they already fit.
+	void resize(int width, int height, unsigned light_count);
+
+	void setGroundPlane(const glm::vec4& plane);
+	// Bounce from which spawned rays play Russian roulette, 0 for none.
+	void setRouletteDepth(int depth);
+
+	// Traces the frame and applies the shader that draws it with a full-screen triangle pass.
+	void render();
+
+	// Rays dropped in the last frame because a queue was full; reads back from the GPU.
+	unsigned getDroppedRays();
+
+private:
+	// layout of QueuedRay and ShadowRay in Wavefront.glsl (std430)
+	static const GLsizeiptr RAY_SIZE = 80;
+	static const GLsizeiptr SHADOW_RAY_SIZE = 64;
+	// ray_dispatch, shadow_dispatch and four counters in front of the accumulation buffer
+	static const GLsizeiptr STATE_HEADER_SIZE = 48;
+
+	Shader* generate;
+	Shader* extend;
+	Shader* shade;
+	Shader* shadow;
+	Shader* queue;
+	Shader* present;
+	Shader::Uniform<unsigned int> queue_stage;
+
+	GLuint ray_queues[2];
+	GLuint shadow_queue;
+	GLuint state;
+
+	int width;
+	int height;
+	unsigned light_count;
+	GLuint ray_capacity;
+	GLuint shadow_capacity;
+
+	void dispatchQueue(GLuint stage);
+};